@@ -0,0 +1,71 @@
+/* comment_scaling.c
+ * Lexes inputs made of one large block comment, doubling its size each step.
+ * Throughput should stay flat as the comment grows; if MB/s drops as size
+ * goes up, something in the comment path has gone back to rescanning.
+ *
+ * usage: lexer-comment-bench [max_mb]   (default 64, sizes run from 1 MB)
+ */
+#include "../include/lexer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Fill buffer with a short statement followed by one block comment that
+ * runs to the end of the buffer
+ */
+static void fill_comment(char *buffer, size_t size) {
+  static const char line[] = " comment body text 0123456789 ** / //\n";
+  const char *head = "x = 1; /*";
+  const char *tail = "*/\n";
+  size_t head_len = strlen(head);
+  size_t tail_len = strlen(tail);
+  size_t pos;
+
+  memcpy(buffer, head, head_len);
+  for (pos = head_len; pos < size - tail_len; pos++) {
+    buffer[pos] = line[(pos - head_len) % (sizeof(line) - 1)];
+  }
+  memcpy(buffer + size - tail_len, tail, tail_len);
+}
+
+int main(int argc, char **argv) {
+  size_t max_mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+  size_t mb;
+
+  printf("%10s %8s %12s %10s\n", "size_mb", "tokens", "seconds", "MB/s");
+
+  for (mb = 1; mb <= max_mb; mb *= 2) {
+    size_t size = mb << 20;
+    char *buffer = malloc(size);
+    Lexer lexer;
+    CompactToken token;
+    size_t tokens = 0;
+    double start, elapsed;
+
+    if (!buffer) {
+      printf("Memory allocation failed.\n");
+      return 1;
+    }
+    fill_comment(buffer, size);
+
+    start = now_seconds();
+    lexer_init(&lexer, buffer, size);
+    do {
+      token = get_next_compact_token(&lexer);
+      tokens++;
+    } while (token.type != TOKEN_EOF);
+    elapsed = now_seconds() - start;
+
+    printf("%10zu %8zu %12.6f %10.1f\n", mb, tokens, elapsed, mb / elapsed);
+    free(buffer);
+  }
+
+  return 0;
+}
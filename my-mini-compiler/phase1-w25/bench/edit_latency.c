@@ -0,0 +1,100 @@
+/* edit_latency.c
+ * Times typing, one character per edit, against an IncrementalLexer and
+ * compares it with lexing the whole file again. The time per keystroke
+ * should stay about the same whatever the size of the file; the full re-lex
+ * and the jump to a new spot (which moves the gap buffers) grow with it.
+ *
+ * usage: lexer-edit-bench file [edits]   (default 10000 edits)
+ */
+#include "../include/incremental.h"
+#include "../include/source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  SourceFile source;
+  IncrementalLexer document;
+  Lexer lexer;
+  CompactToken token;
+  size_t edits = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000;
+  static const char typed[] = "total = x + 1;\n";
+  size_t relexed = 0;
+  size_t i;
+  size_t keystrokes = 0;
+  size_t jumps = 0;
+  double start, full;
+  double typing = 0, jump = 0;
+
+  if (argc < 2) {
+    printf("usage: lexer-edit-bench file [edits]\n");
+    return 1;
+  }
+  if (source_open(&source, argv[1], 1, NULL) != 0) {
+    printf("Error opening file\n");
+    return 1;
+  }
+  if (incremental_init(&document, source.data, source.length) != 0) {
+    printf("Memory allocation failed.\n");
+    return 1;
+  }
+
+  start = now_seconds();
+  lexer_init(&lexer, source.data, source.length);
+  do {
+    token = scan_token(&lexer);
+  } while (token.type != TOKEN_EOF);
+  full = now_seconds() - start;
+
+  // type a short line somewhere, one character at a time, then backspace
+  // over it. The first keystroke at each spot also moves the gaps there, so
+  // it's timed on its own.
+  srand(1);
+  for (i = 0; i < edits; i += 2 * sizeof(typed) - 2) {
+    size_t offset = document.length > 0 ? (size_t)rand() % document.length : 0;
+    size_t k;
+    TokenChange change;
+
+    start = now_seconds();
+    if (incremental_edit(&document, offset, 0, typed, 1, &change) != 0) {
+      printf("Memory allocation failed.\n");
+      return 1;
+    }
+    jump += now_seconds() - start;
+    jumps++;
+
+    start = now_seconds();
+    for (k = 1; k < sizeof(typed) - 1; k++) {
+      if (incremental_edit(&document, offset + k, 0, typed + k, 1, &change) != 0) {
+        printf("Memory allocation failed.\n");
+        return 1;
+      }
+      relexed += change.inserted;
+    }
+    for (k = sizeof(typed) - 1; k > 0; k--) {
+      if (incremental_edit(&document, offset + k - 1, 1, NULL, 0, &change) != 0) {
+        printf("Memory allocation failed.\n");
+        return 1;
+      }
+      relexed += change.inserted;
+    }
+    typing += now_seconds() - start;
+    keystrokes += 2 * sizeof(typed) - 3;
+  }
+
+  printf("file:        %zu bytes, %zu tokens\n", source.length, document.count);
+  printf("full re-lex: %.1f us\n", full * 1e6);
+  printf("keystroke:   %.2f us, %.1f tokens re-lexed\n", typing / keystrokes * 1e6,
+         (double)relexed / keystrokes);
+  printf("jump:        %.2f us to move the gaps and make the first edit\n", jump / jumps * 1e6);
+
+  incremental_free(&document);
+  source_close(&source);
+  return 0;
+}
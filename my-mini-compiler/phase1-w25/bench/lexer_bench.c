@@ -0,0 +1,365 @@
+/* lexer_bench.c
+ * Lexer throughput on generated inputs, one kind of token at a time.
+ * Each category is generated at sizes from --min up to --max, quadrupling,
+ * and lexed with lex_batch (the path the driver uses) for at least 0.2 s;
+ * the fastest pass counts. --cursor reads the tokens through a TokenCursor
+ * instead, peeking one token ahead of each the way a parser would. On
+ * POSIX systems every run is done in a child process, so the peak RSS
+ * reported belongs to that run alone.
+ *
+ * usage: lexer-bench [--min SIZE] [--max SIZE] [--only CATEGORY] [--seed N] [--cursor]
+ *   SIZE takes a K, M or G suffix (default 1K to 64M; 1G works, slowly).
+ *   Categories: ident number comment string error mixed.
+ * Numbers only mean something from an optimized build
+ * (-DCMAKE_BUILD_TYPE=Release).
+ */
+#include "../include/cursor.h"
+#include "../include/lexer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define TOKEN_BATCH_SIZE 256
+#define MIN_SECONDS 0.2
+#define MAX_LINE 256
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int seed = 1;
+static int use_cursor; // Read tokens through a TokenCursor, see --cursor
+
+/* xorshift, so every run of the benchmark lexes the same text */
+static unsigned int next_random(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static unsigned int random_below(unsigned int n) {
+  return next_random() % n;
+}
+
+/* Append an identifier of 1 to 16 characters, now and then a keyword */
+static char *put_identifier(char *out) {
+  static const char *const keywords[] = {"if", "else", "while", "for", "int", "return"};
+  static const char first[] = "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  static const char rest[] = "abcdefghijklmnopqrstuvwxyz_0123456789";
+  int length = 1 + random_below(16);
+  int i;
+
+  if (random_below(8) == 0) {
+    return out + sprintf(out, "%s", keywords[random_below(6)]);
+  }
+  *out++ = first[random_below(sizeof(first) - 1)];
+  for (i = 1; i < length; i++) {
+    *out++ = rest[random_below(sizeof(rest) - 1)];
+  }
+  return out;
+}
+
+static char *put_number(char *out) {
+  return out + sprintf(out, "%s%u", random_below(6) == 0 ? "-" : "", random_below(32768));
+}
+
+static char *put_operator(char *out) {
+  static const char operators[] = "+-*/=%&|";
+
+  *out++ = operators[random_below(sizeof(operators) - 1)];
+  return out;
+}
+
+/* One line of each category; each returns the end of what it wrote, which
+ * is always less than MAX_LINE bytes
+ */
+
+static char *line_ident(char *out) {
+  out = put_identifier(out);
+  out += sprintf(out, " = ");
+  out = put_identifier(out);
+  *out++ = ' ';
+  out = put_operator(out);
+  *out++ = ' ';
+  out = put_identifier(out);
+  out += sprintf(out, ";\n");
+  return out;
+}
+
+static char *line_number(char *out) {
+  int count = 2 + random_below(4);
+  int i;
+
+  out = put_number(out);
+  for (i = 1; i < count; i++) {
+    *out++ = ' ';
+    out = put_operator(out);
+    *out++ = ' ';
+    out = put_number(out);
+  }
+  out += sprintf(out, ";\n");
+  return out;
+}
+
+static char *line_comment(char *out) {
+  static const char words[] = "the quick brown fox jumps over the lazy dog 0123456789 ";
+  int length = 10 + random_below(60);
+  int block = random_below(3) == 0;
+  int i;
+
+  out += sprintf(out, block ? "/* " : "// ");
+  for (i = 0; i < length; i++) {
+    *out++ = words[random_below(sizeof(words) - 1)];
+    if (block && random_below(30) == 0) {
+      *out++ = '\n';
+    }
+  }
+  out += sprintf(out, block ? " */\n" : "\n");
+  return out;
+}
+
+static char *line_string(char *out) {
+  static const char text[] = "Hello, world! 0123456789 abcdefghijklmnopqrstuvwxyz +-*/ ";
+  int length = 5 + random_below(60);
+  int i;
+
+  out = put_identifier(out);
+  out += sprintf(out, " = \"");
+  for (i = 0; i < length; i++) {
+    *out++ = text[random_below(sizeof(text) - 1)];
+  }
+  out += sprintf(out, "\";\n");
+  return out;
+}
+
+static char *line_error(char *out) {
+  switch (random_below(5)) {
+  case 0: // invalid characters
+    return out + sprintf(out, "x @ y $ z # w;\n");
+  case 1: // consecutive operators
+    return out + sprintf(out, "a ++ b -- c ** d;\n");
+  case 2: // malformed numbers
+    return out + sprintf(out, "n = 12ab + 3x4 + 99999;\n");
+  case 3: // unterminated string
+    return out + sprintf(out, "s = \"never closed;\n");
+  default:
+    out = put_identifier(out);
+    return out + sprintf(out, " = `bad`;\n");
+  }
+}
+
+static char *line_mixed(char *out);
+
+typedef struct {
+  const char *name;
+  char *(*line)(char *out);
+} Category;
+
+static const Category categories[] = {
+    {"ident", line_ident},   {"number", line_number}, {"comment", line_comment},
+    {"string", line_string}, {"error", line_error},   {"mixed", line_mixed},
+};
+
+#define CATEGORY_COUNT (sizeof(categories) / sizeof(categories[0]))
+
+static char *line_mixed(char *out) {
+  return categories[random_below(CATEGORY_COUNT - 1)].line(out);
+}
+
+/* Fill size bytes with lines of one category, padding the last line with
+ * spaces so the input never ends part way through a token
+ */
+static void generate(char *buffer, size_t size, const Category *category) {
+  char line[MAX_LINE];
+  size_t pos = 0;
+
+  while (pos < size) {
+    size_t length = category->line(line) - line;
+
+    if (length > size - pos) {
+      memset(buffer + pos, ' ', size - pos);
+      buffer[size - 1] = '\n';
+      break;
+    }
+    memcpy(buffer + pos, line, length);
+    pos += length;
+  }
+}
+
+/* Peak resident set of this process in MB, 0 where it can't be read */
+static double peak_rss_mb(void) {
+#ifndef _WIN32
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+  }
+#endif
+  return 0;
+}
+
+/* Generate, lex and print one line of results */
+static int run(const Category *category, size_t size) {
+  char *buffer = malloc(size);
+  CompactToken tokens[TOKEN_BATCH_SIZE];
+  size_t count = 0;
+  double best = 0;
+  double total = 0;
+
+  if (buffer == NULL) {
+    printf("Memory allocation failed.\n");
+    return 1;
+  }
+  generate(buffer, size, category);
+
+  do {
+    Lexer lexer;
+    size_t batch;
+    double start = now_seconds();
+    double elapsed;
+
+    count = 0;
+    lexer_init(&lexer, buffer, size);
+    if (use_cursor) {
+      TokenCursor cursor;
+
+      cursor_init(&cursor, &lexer);
+      do {
+        cursor_peek(&cursor, 1);
+        count++;
+      } while (cursor_next(&cursor).type != TOKEN_EOF);
+    } else {
+      do {
+        batch = lex_batch(&lexer, tokens, TOKEN_BATCH_SIZE);
+        count += batch;
+      } while (tokens[batch - 1].type != TOKEN_EOF);
+    }
+    elapsed = now_seconds() - start;
+
+    if (best == 0 || elapsed < best) {
+      best = elapsed;
+    }
+    total += elapsed;
+  } while (total < MIN_SECONDS);
+
+  printf("%-8s %12zu %10zu %10.1f %10.2f %10.2f %10.1f\n", category->name, size, count,
+         size / best / (1024 * 1024), count / best / 1e6, best * 1e9 / count, peak_rss_mb());
+  free(buffer);
+  return 0;
+}
+
+/* Run in a child process where possible, so each run's peak RSS is its own */
+static int run_isolated(const Category *category, size_t size) {
+#ifndef _WIN32
+  pid_t child;
+  int status;
+
+  fflush(stdout);
+  child = fork();
+  if (child == 0) {
+    int failed = run(category, size);
+
+    fflush(stdout);
+    _exit(failed);
+  }
+  if (child > 0) {
+    if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status)) {
+      return 1;
+    }
+    return WEXITSTATUS(status);
+  }
+#endif
+  return run(category, size);
+}
+
+/* Parse a size like 4096, 64K, 16M or 1G */
+static size_t parse_size(const char *text) {
+  char *end;
+  size_t size = strtoul(text, &end, 10);
+
+  switch (*end) {
+  case 'G':
+  case 'g':
+    size <<= 10;
+    /* fall through */
+  case 'M':
+  case 'm':
+    size <<= 10;
+    /* fall through */
+  case 'K':
+  case 'k':
+    size <<= 10;
+    break;
+  default:
+    break;
+  }
+  return size;
+}
+
+int main(int argc, char **argv) {
+  size_t min_size = 1 << 10;
+  size_t max_size = 64 << 20;
+  const char *only = NULL;
+  size_t size;
+  size_t c;
+  int matched = 0;
+  int status = 0;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--min") == 0 && i + 1 < argc) {
+      min_size = parse_size(argv[++i]);
+    } else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc) {
+      max_size = parse_size(argv[++i]);
+    } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+      only = argv[++i];
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+      if (seed == 0) {
+        seed = 1;
+      }
+    } else if (strcmp(argv[i], "--cursor") == 0) {
+      use_cursor = 1;
+    } else {
+      printf("usage: lexer-bench [--min SIZE] [--max SIZE] [--only CATEGORY] [--seed N] [--cursor]\n");
+      return 1;
+    }
+  }
+  if (min_size == 0) {
+    min_size = 1;
+  }
+
+  printf("%-8s %12s %10s %10s %10s %10s %10s\n", "category", "bytes", "tokens", "MB/s", "Mtok/s", "ns/token",
+         "peak_rss_mb");
+  for (c = 0; c < CATEGORY_COUNT; c++) {
+    if (only != NULL && strcmp(only, categories[c].name) != 0) {
+      continue;
+    }
+    matched = 1;
+    for (size = min_size; size <= max_size; size *= 4) {
+      status |= run_isolated(&categories[c], size);
+      if (size > max_size / 4) {
+        break;
+      }
+    }
+  }
+  if (!matched) {
+    printf("Unknown category %s\n", only);
+    return 1;
+  }
+  return status;
+}
@@ -0,0 +1,50 @@
+/* arena.h */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Bytes a new block gets unless one allocation needs more */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+
+/* Bump allocator for memory that lives as long as one run of the lexer
+ * (a file's text, symbols, token arrays)
+ * Allocations are carved off the front of large blocks and never freed one
+ * by one; the whole arena is reset or freed at once. A reset keeps the
+ * blocks for the next file, so lexing file after file reuses the same
+ * memory instead of going back to malloc.
+ */
+typedef struct Arena {
+  ArenaBlock *first;   // Chain of blocks, in the order they're used
+  ArenaBlock *current; // Block allocations come from, NULL before the first
+  size_t used;         // Bytes of current handed out
+} Arena;
+
+/* Start an empty arena; nothing is allocated until the first request */
+void arena_init(Arena *arena);
+
+/* size bytes aligned for any type, or NULL if memory runs out */
+void *arena_alloc(Arena *arena, size_t size);
+
+/* Copy of size bytes of data with no alignment padding (for text), or
+ * NULL if memory runs out
+ */
+char *arena_copy(Arena *arena, const char *data, size_t size);
+
+/* Grow the allocation of old_size bytes at old (NULL if there's none yet)
+ * to new_size bytes, in place if it's the last one made and its block has
+ * room, else by copying it; a copy leaves the old bytes in the arena, which
+ * doubling keeps to less than the new size. Returns where the allocation
+ * now is, or NULL if memory runs out and old is unchanged.
+ */
+void *arena_grow(Arena *arena, void *old, size_t old_size, size_t new_size);
+
+/* Forget every allocation but keep the blocks, in constant time */
+void arena_reset(Arena *arena);
+
+/* Give every block back to the system */
+void arena_free(Arena *arena);
+
+#endif /* ARENA_H */
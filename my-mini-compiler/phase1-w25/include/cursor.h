@@ -0,0 +1,62 @@
+/* cursor.h */
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include "lexer.h"
+
+/* Tokens a cursor keeps, so the furthest it can peek is CURSOR_LOOKAHEAD - 1
+ * tokens past the next one (a power of two)
+ */
+#define CURSOR_LOOKAHEAD 16
+
+/* A point to come back to: a token index and the lexer's state just before
+ * it was lexed
+ */
+typedef struct {
+  size_t index;         // Tokens cursor_next had returned at this point
+  size_t pos;
+  size_t line_start;
+  int line;
+  int in_comment;
+  char last_token_type;
+} CursorMark;
+
+/* Tokens read on demand, for a parser that needs lookahead or backtracking
+ * Tokens are lexed only when cursor_peek or cursor_next first asks for them
+ * and kept in a small ring, so however long the input the cursor never
+ * holds more than CURSOR_LOOKAHEAD of them. cursor_reset goes back to a
+ * mark: while its token is still in the ring nothing is lexed again,
+ * otherwise the lexer is put back where it was and lexes from there, adding
+ * no diagnostics for tokens it had lexed before. Tokens are the ones
+ * get_next_compact_token returns, so skip_comments and the other options
+ * apply as usual.
+ */
+typedef struct {
+  Lexer *lexer;
+  CompactToken tokens[CURSOR_LOOKAHEAD]; // Token i is at tokens[i % CURSOR_LOOKAHEAD]
+  CursorMark starts[CURSOR_LOOKAHEAD];   // Where the lexer was before each of them
+  size_t head;  // Index of the token cursor_next returns next
+  size_t first; // Tokens first to tail are in the ring, first <= head <= tail
+  size_t tail;  // Index of the next token to lex
+  size_t lexed; // Furthest tail has been, diagnostics are only added past it
+} TokenCursor;
+
+/* Set up a cursor reading tokens from lexer, which it lexes from where it is */
+void cursor_init(TokenCursor *cursor, Lexer *lexer);
+
+/* The token n places after the next one (n = 0 is the next one) without
+ * consuming anything; n is at most CURSOR_LOOKAHEAD - 1, and larger values
+ * give that token. Past the end every token is EOF.
+ */
+CompactToken cursor_peek(TokenCursor *cursor, size_t n);
+
+/* Consume and return the next token */
+CompactToken cursor_next(TokenCursor *cursor);
+
+/* Mark the cursor's position, before the token cursor_next returns next */
+CursorMark cursor_mark(const TokenCursor *cursor);
+
+/* Go back (or forward) to a mark taken on this cursor */
+void cursor_reset(TokenCursor *cursor, const CursorMark *mark);
+
+#endif /* CURSOR_H */
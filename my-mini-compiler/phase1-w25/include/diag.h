@@ -0,0 +1,73 @@
+/* diag.h */
+#ifndef DIAG_H
+#define DIAG_H
+
+#include "arena.h"
+#include "tokens.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* How bad a diagnostic is */
+typedef enum {
+  SEVERITY_ERROR, // A lexical error; lexing carries on after it
+  SEVERITY_FATAL  // Lexing stopped here
+} Severity;
+
+/* One problem found in the input
+ * The span is the bytes the lexer skipped over for it, which are also the
+ * bytes of its error token. After each kind of error the lexer picks up
+ * again at:
+ *   ERROR_INVALID_CHAR           the next byte that can start a token (in
+ *                                UTF-8 mode, or identifier character), so a
+ *                                run of bad bytes is one error
+ *   ERROR_INVALID_NUMBER_FORMAT  the next byte that can end a number
+ *   ERROR_INVALID_NUMBER_VALUE   the end of the number
+ *   ERROR_UNTERMINATED_STRING    the end of the line (or the length limit)
+ *   ERROR_CONSECUTIVE_OPERATORS  the byte after the operator
+ *   ERROR_IDENTIFIER_TOO_LONG    the length limit, the rest being the next token
+ *   ERROR_INVALID_UTF8           the end of the string or comment, kept whole
+ * ERROR_TOO_MANY_ERRORS is the fatal diagnostic added when the cap is
+ * reached; its span is empty, at the first byte left unlexed.
+ */
+typedef struct {
+  ErrorType code;
+  Severity severity;
+  uint32_t offset; // Span, in bytes of the lexer's input
+  uint32_t length;
+  int line;        // Where the span starts
+  int column;
+} Diagnostic;
+
+/* Diagnostics gathered while lexing, to be reported all together
+ * A lexer given one (Lexer.diagnostics) adds a diagnostic for every error
+ * token it returns, and once max_errors errors have been added it adds an
+ * ERROR_TOO_MANY_ERRORS and returns EOF from then on. The items are
+ * allocated in an arena.
+ */
+typedef struct Diagnostics {
+  Diagnostic *items;
+  size_t count;
+  size_t capacity;
+  size_t errors;     // SEVERITY_ERROR diagnostics added, kept even if items couldn't be
+  size_t max_errors; // Stop lexing after this many errors, 0 for no limit
+  int stopped;       // The limit was reached
+  int failed;        // Memory ran out and some diagnostics were lost
+  Arena *arena;
+} Diagnostics;
+
+/* Start an empty buffer allocating from arena, stopping after max_errors
+ * errors (0 for never)
+ */
+void diag_init(Diagnostics *diagnostics, Arena *arena, size_t max_errors);
+
+/* Add a diagnostic, returning 1 if it was an error that reached the limit
+ * and lexing should stop, else 0. If memory runs out the diagnostic is
+ * dropped and failed set, but errors are still counted against the limit.
+ */
+int diag_add(Diagnostics *diagnostics, ErrorType code, Severity severity, size_t offset, size_t length, int line,
+             int column);
+
+/* Name printed for a severity, e.g. "error" */
+const char *severity_name(Severity severity);
+
+#endif /* DIAG_H */
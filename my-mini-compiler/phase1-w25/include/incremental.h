@@ -0,0 +1,64 @@
+/* incremental.h */
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "lexer.h"
+
+/* A document kept lexed through a series of edits
+ * After an edit only the tokens around it are lexed again: lexing restarts
+ * at the end of the last token the edit can't have changed and stops as
+ * soon as it is back in step with the old tokens. The tokens always match
+ * lexing text from scratch with default options (comments included).
+ *
+ * The text and the tokens are both kept in gap buffers with the gap at the
+ * last edit. Tokens after the gap store their offset and line counted back
+ * from the end of the document, so an edit never has to shift them, and
+ * only the few bytes lexed again are moved across the text gap. The time an
+ * edit takes depends on its size and on how far the gap has to move from
+ * the previous edit, not on the size of the document.
+ */
+typedef struct {
+  char *text;           // Gap buffer of the contents, see incremental_text
+  size_t text_capacity;
+  size_t gap_start;     // Offset where the text gap starts
+  size_t gap_end;       // Index in text where the text after the gap resumes
+  size_t length;        // Bytes of text, not counting the gap
+  uint32_t lines;       // Line of the end of text
+  CompactToken *tokens; // Gap buffer, read it with incremental_token
+  size_t capacity;
+  size_t before;        // Tokens before the gap, at the start of tokens
+  size_t after;         // Tokens after the gap, at the end of tokens
+  size_t count;         // before + after
+} IncrementalLexer;
+
+/* Where an edit changed the tokens: [first, first + removed) were replaced
+ * by [first, first + inserted), later ones were only shifted
+ */
+typedef struct {
+  size_t first;
+  size_t removed;
+  size_t inserted;
+} TokenChange;
+
+/* Copy text and lex it; returns 0, or -1 if memory runs out */
+int incremental_init(IncrementalLexer *document, const char *text, size_t length);
+
+/* Replace deleted bytes at offset with inserted_length bytes of inserted
+ * and bring the tokens up to date, describing what changed in *change if
+ * it isn't NULL. Returns 0, or -1 if the range is out of bounds (nothing
+ * is changed) or memory runs out (the document can only be freed).
+ */
+int incremental_edit(IncrementalLexer *document, size_t offset, size_t deleted, const char *inserted,
+                     size_t inserted_length, TokenChange *change);
+
+/* Token index of the document, 0 <= index < count */
+CompactToken incremental_token(const IncrementalLexer *document, size_t index);
+
+/* The whole text, contiguous (closing the text gap, so the next edit moves
+ * it back); valid until the next edit
+ */
+const char *incremental_text(IncrementalLexer *document);
+
+void incremental_free(IncrementalLexer *document);
+
+#endif /* INCREMENTAL_H */
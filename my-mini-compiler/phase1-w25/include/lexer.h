@@ -0,0 +1,139 @@
+/* lexer.h */
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "tokens.h"
+#include <stddef.h>
+
+struct ScanOps;
+struct SymbolTable;
+struct LineIndex;
+struct Diagnostics;
+
+/* Default length limits, the longest lexemes that fit a Token's inline
+ * buffer; lexing is the same as it was before the limits could be changed
+ */
+#define LEXEME_LIMIT_DEFAULT (MAX_LEXEME_SIZE - 1)
+
+/* Which characters past ASCII identifiers may use, in UTF-8 mode */
+typedef enum {
+  IDENTIFIERS_C11,   // The ones C11 allows (Annex D), the default
+  IDENTIFIERS_ASCII, // None, they are invalid characters as without UTF-8
+  IDENTIFIERS_ANY    // Any well-formed character
+} IdentifierPolicy;
+
+/* Options that change how the lexer behaves
+ * The limits are in bytes of lexeme, 0 meaning no limit. An identifier that
+ * reaches its limit is cut there with ERROR_IDENTIFIER_TOO_LONG, a string
+ * that isn't closed within its limit is ERROR_UNTERMINATED_STRING, and a
+ * number or line comment simply ends at its limit (the rest is lexed as the
+ * next token).
+ * In UTF-8 mode a string or comment that isn't well-formed UTF-8 is
+ * ERROR_INVALID_UTF8, identifiers may use the characters the policy allows,
+ * and runs of invalid characters end before one that can start an
+ * identifier. Without it every byte past ASCII is an invalid character.
+ */
+typedef struct {
+  int skip_comments;       // Don't return comment tokens, keep scanning instead
+  size_t max_identifier;   // Identifiers and keywords
+  size_t max_string;       // String literals, quotes included
+  size_t max_number;       // Numbers, sign included
+  size_t max_line_comment; // Line comments, the // included
+  int utf8;                // Input is UTF-8
+  IdentifierPolicy identifiers; // Characters past ASCII allowed in identifiers, with utf8
+} LexerOptions;
+
+/* Lexer state
+ * Everything get_next_token needs lives here, so separate lexers never share
+ * state and can run one after another or on different threads.
+ */
+typedef struct {
+  const char *input;    // Source buffer, doesn't need to be NUL-terminated
+  size_t length;        // Number of bytes in input
+  size_t pos;           // Offset of the next character to read
+  int line;             // Current line number
+  size_t line_start;    // Offset of the first character of the current line
+  char last_token_type; // Class of the previous token, for checking consecutive operators
+  int in_comment;       // Set to resume inside a block comment, see stream.c
+  const struct ScanOps *scan; // Whitespace/comment/string loops for this CPU, see scan.h
+  struct SymbolTable *symbols; // If set, identifiers and strings are interned here
+  struct LineIndex *lines;     // If set, the lines of all of input (see lineindex.h), used instead of counting
+  struct Diagnostics *diagnostics; // If set, errors are added here and can stop lexing early (see diag.h)
+  size_t utf8_from;     // In UTF-8 mode, input from here to utf8_error is known to be well-formed,
+  size_t utf8_error;    // where a malformed sequence (or the end) starts; unknown if from > error
+  LexerOptions options;
+} Lexer;
+
+/* Set up a lexer at the start of input with default options
+ * length is the size of input in bytes; compact token offsets are 32-bit so
+ * inputs must stay under 4 GiB.
+ */
+void lexer_init(Lexer *lexer, const char *input, size_t length);
+
+/* The options lexer_init gives a lexer: no UTF-8, comments returned, C11
+ * identifiers and every limit LEXEME_LIMIT_DEFAULT
+ */
+LexerOptions lexer_default_options(void);
+
+/* Set every length limit in options to limit (0 for no limit) */
+void lexer_set_limits(LexerOptions *options, size_t limit);
+
+/* Column (1-based) of the next character to read */
+int lexer_column(const Lexer *lexer);
+
+/* Line and column of a byte offset in the lexer's input
+ * With a line index (lexer.lines) this works for any offset and takes
+ * O(log n). Without one, offsets on the lexer's current line are found
+ * directly and earlier ones by reading back through the input to them.
+ */
+SourceLocation lexer_locate(const Lexer *lexer, size_t offset);
+
+/* Scan one token, returning comments even when skip_comments is set
+ * With diagnostics, once the error limit is reached the input is cut short
+ * at the end of the last error (lexer.length drops to pos), so every call
+ * after it returns EOF there.
+ */
+CompactToken scan_token(Lexer *lexer);
+
+/* The lexer's last_token_type after it returns token, given the value it
+ * had before (for restarting a lexer part way through its input)
+ */
+char last_type_after(char last, CompactToken token);
+
+/* Get next token from the lexer's input without copying its lexeme */
+CompactToken get_next_compact_token(Lexer *lexer);
+
+/* Lex up to capacity tokens into tokens and return how many were written
+ * The batch ends early after the EOF token, so a short count means the
+ * input is done.
+ */
+size_t lex_batch(Lexer *lexer, CompactToken *tokens, size_t capacity);
+
+/* Expand a compact token into a Token, with the start of its lexeme copied
+ * and all of it viewed in place, and its column and end found with
+ * lexer_locate. Only valid while the lexer's input is.
+ */
+Token expand_token(const Lexer *lexer, CompactToken compact);
+
+/* Build a Token from a compact token and the text_length bytes of its
+ * lexeme kept at text (normally compact.length). Without the lexer the
+ * column and end aren't known and are left 0.
+ */
+Token token_from_text(CompactToken compact, const char *text, size_t text_length);
+
+/* Get next token from the lexer's input, lexeme copied (debug view) */
+Token get_next_token(Lexer *lexer);
+
+/* Spelling of a keyword, "" for KEYWORD_NONE */
+const char *keyword_name(KeywordId keyword);
+
+/* Name printed for a token type, e.g. "NUMBER" */
+const char *token_type_name(TokenType type);
+
+/* Message printed for a lexical error, without the lexeme */
+const char *error_message(ErrorType error);
+
+void print_error(ErrorType error, int line, const char *lexeme);
+void print_token(Token token);
+
+#endif /* LEXER_H */
@@ -0,0 +1,45 @@
+/* lineindex.h */
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include "arena.h"
+#include "tokens.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Offsets where lines start, for turning byte offsets back into lines and
+ * columns without reading the source again
+ * line_index_build finds every line of an input in one vectorized pass,
+ * normally right after it's loaded. A lexer given the index (Lexer.lines)
+ * looks its lines up there instead of counting newlines as it scans.
+ * Line 1 starts at offset 0 and isn't stored. The starts are allocated in
+ * an arena.
+ */
+typedef struct LineIndex {
+  uint32_t *starts; // starts[i] is where line i + 2 starts, in increasing order
+  size_t count;
+  size_t capacity;
+  Arena *arena;
+} LineIndex;
+
+/* Start an empty index (one line, at offset 0) allocating from arena */
+void line_index_init(LineIndex *index, Arena *arena);
+
+/* Replace what the index holds with the lines of the length bytes at
+ * input (a line starts after every '\n'). Returns 0, or -1 if memory runs
+ * out.
+ */
+int line_index_build(LineIndex *index, const char *input, size_t length);
+
+/* What line_index_start returns for a line the index doesn't have */
+#define LINE_INDEX_NONE ((size_t)-1)
+
+/* Offset where line (1-based) starts, in constant time, or LINE_INDEX_NONE
+ * if line is before the first or after the last
+ */
+size_t line_index_start(const LineIndex *index, int line);
+
+/* Line and column of offset, by binary search over the line starts */
+SourceLocation line_index_locate(const LineIndex *index, size_t offset);
+
+#endif /* LINEINDEX_H */
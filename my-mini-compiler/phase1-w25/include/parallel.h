@@ -0,0 +1,15 @@
+/* parallel.h */
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "lexer.h"
+
+/* Lex input on up to jobs threads (0 for one per CPU)
+ * Returns a malloc'd array of *count tokens ending with the EOF token,
+ * exactly the tokens one Lexer with these options would return, or NULL if
+ * memory runs out. Inputs too small to be worth splitting are lexed on the
+ * calling thread. Nothing is interned (symbol IDs are left 0).
+ */
+CompactToken *lex_parallel(const char *input, size_t length, LexerOptions options, int jobs, size_t *count);
+
+#endif /* PARALLEL_H */
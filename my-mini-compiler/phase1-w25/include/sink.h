@@ -0,0 +1,54 @@
+/* sink.h */
+#ifndef SINK_H
+#define SINK_H
+
+#include "diag.h"
+#include "tokens.h"
+#include <stddef.h>
+
+#define SINK_BUFFER_SIZE (64 * 1024)
+
+/* Where a sink's full buffer goes; context is whatever was given to sink_init */
+typedef void (*SinkWrite)(void *context, const char *data, size_t size);
+
+/* Token output
+ * Lines are formatted into buffer the same way print_token prints them and
+ * handed to write only when the buffer fills or on sink_flush, so printing a
+ * token costs a few memcpys instead of several printf calls. A quiet sink
+ * writes nothing and only keeps the counts.
+ */
+typedef struct {
+  SinkWrite write;
+  void *context;
+  int quiet;                // Count tokens but don't format them
+  int errors_apart;         // Count error tokens but don't format them, see sink_diagnostics
+  size_t used;              // Bytes waiting in buffer
+  unsigned long long tokens; // Tokens seen, EOF included
+  unsigned long long errors; // Tokens that carried an error
+  char buffer[SINK_BUFFER_SIZE];
+} TokenSink;
+
+void sink_init(TokenSink *sink, SinkWrite write, void *context, int quiet);
+
+/* Print one token; text holds the text_length bytes kept of its lexeme,
+ * normally token.length (ignored for EOF)
+ */
+void sink_token(TokenSink *sink, CompactToken token, const char *text, size_t text_length);
+
+/* Print diagnostics gathered from input, one line each, e.g.
+ *   error E01 at line 3, column 7: Invalid character '@#'
+ * The fatal one (if lexing stopped early) is always printed, the errors
+ * only if errors is set, normally for a sink with errors_apart.
+ */
+void sink_diagnostics(TokenSink *sink, const Diagnostics *diagnostics, const char *input, int errors);
+
+/* Append raw bytes to the output */
+void sink_write(TokenSink *sink, const char *data, size_t size);
+
+/* Hand everything buffered to write */
+void sink_flush(TokenSink *sink);
+
+/* SinkWrite for a FILE *, e.g. stdout */
+void sink_write_file(void *file, const char *data, size_t size);
+
+#endif /* SINK_H */
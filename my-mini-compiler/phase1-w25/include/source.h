@@ -0,0 +1,31 @@
+/* source.h */
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include "arena.h"
+#include <stddef.h>
+
+/* Largest file that can be loaded, since compact tokens hold 32-bit offsets */
+#define SOURCE_MAX_LENGTH 0xFFFFFFFFu
+
+/* A source file loaded for lexing */
+typedef struct {
+  const char *data; // File contents, not NUL-terminated
+  size_t length;    // Size of the file in bytes
+  int mapped;       // 1 if data is a read-only mapping, 0 if it was read into memory
+  int in_arena;     // 1 if data was read into an arena, which owns it
+} SourceFile;
+
+/* Load the file at path. With use_mmap set (and on platforms that have it)
+ * the file is mapped read-only and lexed in place, with no copy. A file
+ * that is read instead goes into arena if it isn't NULL, else the heap.
+ * Input that can't seek, like a pipe, is read to its end into the heap.
+ * Returns 0 on success and -1 on error, with errno set (EFBIG for a file
+ * over SOURCE_MAX_LENGTH bytes).
+ */
+int source_open(SourceFile *source, const char *path, int use_mmap, Arena *arena);
+
+/* Release whatever source_open acquired */
+void source_close(SourceFile *source);
+
+#endif /* SOURCE_H */
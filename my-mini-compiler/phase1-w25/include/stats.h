@@ -0,0 +1,29 @@
+/* stats.h */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/* Where the lexer spends its time
+ * Built with LEXER_STATS defined (cmake -DLEXER_STATS=ON), every token is
+ * counted against the recognizer that produced it, with its bytes and the
+ * time it took (cycles from rdtsc on x86, nanoseconds elsewhere); the
+ * whitespace skipped before tokens is counted the same way, and errors are
+ * counted by kind. Only tokens that are returned count: those scanned and
+ * then thrown away to be scanned again (as a stream's window grows, where a
+ * parallel segment guessed wrong, after a cursor reset) are counted as
+ * "relexed" instead, though the time they took stays with the recognizers.
+ * Each thread counts on its own and adds its counts to the totals when it
+ * ends. The totals are written to stderr at exit, as JSON if the
+ * environment variable LEXER_STATS is "json" and as a table otherwise.
+ *
+ * Without LEXER_STATS none of the counting is compiled in.
+ */
+
+/* Write the totals so far (the calling thread's counts included) as a
+ * table, or as JSON if json is set. Returns 0, or -1 if the lexer was
+ * built without LEXER_STATS, in which case nothing is written.
+ */
+int lexer_stats_write(FILE *out, int json);
+
+#endif /* STATS_H */
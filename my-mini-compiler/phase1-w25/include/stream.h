@@ -0,0 +1,55 @@
+/* stream.h */
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "lexer.h"
+
+/* Read up to size bytes into buffer, returning how many were read and 0
+ * once the input is exhausted
+ */
+typedef size_t (*StreamRead)(void *context, char *buffer, size_t size);
+
+/* Lexer for input that arrives in chunks (a pipe, a socket, stdin)
+ * Only a window of the input is kept in memory: about two chunks plus the
+ * longest token, except block comments and runs of invalid characters,
+ * which are followed across chunks without being kept. Tokens are the same
+ * as lexing the whole input at once, with offsets counted from the start of
+ * the stream. The text of a block comment or invalid run that outgrew the
+ * window is only kept up to MAX_LEXEME_SIZE - 1 bytes (see text_length).
+ * Offsets are 32-bit, so only the first 4 GiB - 1 bytes of a stream are
+ * lexed: past that it ends as if the input did, with too_long set.
+ */
+typedef struct {
+  Lexer lexer;                     // Lexer over the current window
+  StreamRead read;                 // Where input comes from
+  void *context;                   // Passed to read
+  char *window;                    // Input not yet consumed by the lexer
+  size_t window_length;            // Bytes in window
+  size_t capacity;                 // Size of the window allocation
+  size_t chunk_size;               // Bytes asked for on each read
+  unsigned long long window_start; // Stream offset of window[0]
+  int at_end;                      // read has reported the end of input
+  int failed;                      // Out of memory, lexing stopped early
+  int too_long;                    // The stream went on past 4 GiB - 1 bytes, lexing stopped there
+  const char *text;                // Lexeme of the last token returned
+  size_t text_length;              // Bytes of it kept at text, the whole token but for a huge comment
+  char head[MAX_LEXEME_SIZE];       // Start of a comment or invalid run that outgrew the window
+} StreamLexer;
+
+/* Set up a stream lexer reading chunk_size bytes at a time from read
+ * Returns 0 on success, -1 if the window can't be allocated
+ */
+int stream_lexer_init(StreamLexer *stream, StreamRead read, void *context, size_t chunk_size);
+
+/* Get the next token, reading more input as needed */
+CompactToken stream_next_token(StreamLexer *stream);
+
+/* Expand the token stream_next_token just returned into a Token */
+Token stream_expand_token(const StreamLexer *stream, CompactToken compact);
+
+void stream_lexer_free(StreamLexer *stream);
+
+/* StreamRead for a FILE *, e.g. stdin */
+size_t stream_read_file(void *file, char *buffer, size_t size);
+
+#endif /* STREAM_H */
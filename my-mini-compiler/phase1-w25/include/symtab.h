@@ -0,0 +1,48 @@
+/* symtab.h */
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "arena.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest symbol ID, IDs have to fit in CompactToken.id */
+#define SYMBOL_MAX ((1u << 24) - 1)
+
+/* One interned string */
+typedef struct {
+  const char *text; // Copy in the table's arena, not NUL-terminated
+  uint32_t length;
+  uint32_t hash;
+} Symbol;
+
+/* Interning table: every distinct string gets a dense ID from 1 up, so two
+ * names can be compared by ID alone. Open addressing over the IDs, with the
+ * text copied once into an arena, so memory grows with the number of
+ * distinct strings and not with how often they appear. Everything the table
+ * holds is in the arena and goes when it is reset or freed; there's nothing
+ * else to free.
+ */
+typedef struct SymbolTable {
+  uint32_t *slots;   // Symbol ID per slot, 0 for empty
+  size_t slot_count; // Power of two, at least twice count
+  Symbol *symbols;   // symbols[id - 1]
+  size_t count;
+  size_t capacity;
+  Arena *arena;      // Where the slots, symbols and texts are allocated
+} SymbolTable;
+
+/* Start an empty table allocating from arena; nothing is allocated until
+ * the first symbol
+ */
+void symtab_init(SymbolTable *table, Arena *arena);
+
+/* ID of the length bytes at text, adding them if they're new
+ * Returns 0 if memory runs out or the table already holds SYMBOL_MAX strings.
+ */
+uint32_t symtab_intern(SymbolTable *table, const char *text, size_t length);
+
+/* Text of a symbol, NULL for an ID the table doesn't have */
+const char *symtab_text(const SymbolTable *table, uint32_t id, size_t *length);
+
+#endif /* SYMTAB_H */
@@ -6,8 +6,11 @@
 #ifndef TOKENS_H
 #define TOKENS_H
 
+#include <stdint.h>
+
 #define MAX_NUMBER_SIZE 32767
 #define MIN_NUMBER_SIZE -32768
+#define MAX_LEXEME_SIZE 100 // Bytes of lexeme a Token keeps inline, NUL included
 
 /* Token types that need to be recognized by the lexer
  * TODO: Add more token types as per requirements:
@@ -29,6 +32,18 @@ typedef enum {
   TOKEN_ERROR
 } TokenType;
 
+/* Keywords, generated from keywords.def
+ * Keyword tokens carry one of these so later phases can switch on it
+ * instead of comparing the lexeme again.
+ */
+typedef enum {
+  KEYWORD_NONE,
+#define KEYWORD(id, text) KEYWORD_##id,
+#include "keywords.def"
+#undef KEYWORD
+  KEYWORD_COUNT
+} KeywordId;
+
 /* Error types for lexical analysis
  * TODO: Add more error types as needed for your language - as much as you like
  * !!
@@ -40,7 +55,9 @@ typedef enum {
   ERROR_INVALID_NUMBER_FORMAT,
   ERROR_CONSECUTIVE_OPERATORS,
   ERROR_UNTERMINATED_STRING,
-  ERROR_IDENTIFIER_TOO_LONG
+  ERROR_IDENTIFIER_TOO_LONG,
+  ERROR_INVALID_UTF8,   // A string or comment that isn't well-formed UTF-8, in UTF-8 mode
+  ERROR_TOO_MANY_ERRORS // Only a diagnostic (see diag.h); token errors fit the 3 bits tokfile.c gives them
 } ErrorType;
 
 /* Token structure to store token information
@@ -51,9 +68,39 @@ typedef enum {
  */
 typedef struct {
   TokenType type;
-  char lexeme[100]; // Actual text of the token
-  int line;         // Line number in source file
-  ErrorType error;  // Error type if any
+  char lexeme[MAX_LEXEME_SIZE]; // Text of the token, NUL-terminated; cut short if it's longer, see text
+  int line;                     // Line number in source file, of the token's first byte
+  int column;                   // Column (1-based, in bytes) of its first byte
+  uint32_t offset;              // Byte offset of its first byte; the token covers offset to offset + length
+  int end_line;                 // Line and column just past its last byte (line and column + length
+  int end_column;               // unless it spans lines); these three are 0 if unknown, see lexer.h
+  ErrorType error;              // Error type if any
+  KeywordId keyword;            // Which keyword, for TOKEN_KEYWORD
+  uint32_t symbol;              // Symbol ID of an identifier or string, 0 if not interned
+  const char *text;             // All of the lexeme, length bytes, not NUL-terminated; a view of
+  uint32_t length;              // the lexer's input, so nothing is copied however long it is
 } Token;
 
+/* Compact token: the lexeme is not copied, the token only records where it
+ * sits in the source buffer. Token above is the debug view of the same data.
+ * Columns aren't stored; a line index gives them back, see lineindex.h.
+ */
+typedef struct {
+  uint32_t offset;   // Byte offset of the lexeme in the source buffer
+  uint32_t length;   // Length of the lexeme in bytes
+  uint32_t line;     // Line number in source file, of the lexeme's first byte
+  uint32_t type : 4;  // TokenType
+  uint32_t error : 4; // ErrorType
+  uint32_t id : 24;   // KeywordId of a keyword; symbol ID of an identifier or
+                      // string when the lexer interns them (see symtab.h), else 0
+} CompactToken;
+
+_Static_assert(sizeof(CompactToken) == 16, "CompactToken should stay 16 bytes");
+
+/* Where a byte sits in the source, both 1-based; the column counts bytes */
+typedef struct {
+  int line;
+  int column;
+} SourceLocation;
+
 #endif /* TOKENS_H */
@@ -0,0 +1,98 @@
+/* tokfile.h */
+#ifndef TOKFILE_H
+#define TOKFILE_H
+
+#include "symtab.h"
+#include "tokens.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Binary token files
+ * A lexed token stream saved so a later phase (or a later run) can read the
+ * tokens back without the source or the lexer. All integers are little
+ * endian. The layout is
+ *
+ *   header          magic "LXTK", version, token count, string count, the
+ *                   file offsets of the three sections below and the file size
+ *   string offsets  string_count + 1 uint32s, string i is bytes
+ *                   [offsets[i], offsets[i + 1]) of the string data
+ *   string data     every distinct lexeme once, not NUL-terminated
+ *   tokens          one record per token:
+ *                     byte    type | error << 4, plus 0x80 if length is stored
+ *                     byte    keyword, only when type is TOKEN_KEYWORD
+ *                     varint  bytes between the previous token's end and this offset
+ *                     varint  length, only when it isn't the lexeme's length
+ *                     varint  line minus the previous token's line, zigzag encoded
+ *                     varint  string index of the lexeme
+ *
+ * Symbol IDs aren't saved; the string index does the same job in the file.
+ * Varints are LEB128, 7 bits a byte with the high bit meaning more follow.
+ * Nothing in the file needs aligning or fixing up, so a reader can work
+ * straight off a read-only mapping.
+ */
+
+#define TOKFILE_MAGIC "LXTK"
+#define TOKFILE_VERSION 1
+#define TOKFILE_HEADER_SIZE 32
+
+/* Collects tokens and writes them out as a token file */
+typedef struct {
+  unsigned char *records; // Encoded token records
+  size_t records_length;
+  size_t records_capacity;
+  Arena arena;            // Holds strings
+  SymbolTable strings;    // String index + 1 is the symbol ID
+  size_t strings_length;  // Bytes of string data
+  size_t token_count;
+  uint32_t last_end;      // Offset just past the previous token
+  uint32_t last_line;     // Line of the previous token
+} TokenFileWriter;
+
+/* Returns 0 on success, -1 if memory runs out */
+int tokfile_writer_init(TokenFileWriter *writer);
+
+/* Add a token; text holds the text_length bytes stored as its lexeme, which
+ * is normally token.length but can be less (e.g. a stream lexer only keeps
+ * the start of a huge comment). Returns 0, or -1 if memory runs out.
+ */
+int tokfile_add(TokenFileWriter *writer, CompactToken token, const char *text, size_t text_length);
+
+/* Write the whole file; returns 0, or -1 if writing fails */
+int tokfile_write(const TokenFileWriter *writer, FILE *file);
+
+void tokfile_writer_free(TokenFileWriter *writer);
+
+/* A token file in memory, usually a mapping from source_open */
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  uint32_t token_count;
+  uint32_t string_count;
+  const unsigned char *string_offsets;
+  const char *strings;
+  const unsigned char *tokens;
+} TokenFile;
+
+/* Check the header and find the sections of the size bytes at data
+ * Returns 0 on success, -1 if data isn't a token file this code can read.
+ */
+int tokfile_open(TokenFile *file, const void *data, size_t size);
+
+/* Walks the token records of a TokenFile in order */
+typedef struct {
+  const TokenFile *file;
+  const unsigned char *pos;
+  uint32_t remaining;
+  uint32_t last_end;
+  uint32_t last_line;
+} TokenFileCursor;
+
+void tokfile_cursor_init(TokenFileCursor *cursor, const TokenFile *file);
+
+/* Decode the next token and point text at its lexeme in the file
+ * Returns 1 for a token, 0 after the last one, -1 if the file is corrupt.
+ */
+int tokfile_next(TokenFileCursor *cursor, CompactToken *token, const char **text, size_t *text_length);
+
+#endif /* TOKFILE_H */
@@ -0,0 +1,458 @@
+/* batch.c */
+#include "batch.h"
+#include "../../include/lexer.h"
+#include "../../include/diag.h"
+#include "../../include/lineindex.h"
+#include "../../include/sink.h"
+#include "../../include/source.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TOKEN_BATCH_SIZE 256
+
+/* Most output held for files that aren't the next to print, summed over
+ * all of them; a worker that would go over waits for its file's turn.
+ */
+#ifndef BATCH_BUFFER_LIMIT
+#define BATCH_BUFFER_LIMIT (16 * 1024 * 1024)
+#endif
+
+/* Output of one file, filled in by whichever worker lexes it */
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+  unsigned long long tokens;
+  unsigned long long errors;
+  int missing; // Couldn't be opened
+  int failed;  // Memory ran out, data is cut short
+  int streaming; // Next to print, so written straight to stdout
+  int done;   // Guarded by Batch.lock
+} FileResult;
+
+/* A worker's share of the files, as a range of indices into the file list
+ * The owner takes files from the front and thieves take them from the back,
+ * so the owner works through its files in order while idle workers pick
+ * off the ones it would have reached last.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  size_t front;
+  size_t back; // One past the last file left
+} WorkQueue;
+
+typedef struct Batch Batch;
+
+typedef struct {
+  Batch *batch;
+  size_t id;
+  TokenSink sink;
+  FileResult *result; // File being written through sink
+  Arena arena;        // Memory for the file being lexed, reset after each one
+} Worker;
+
+struct Batch {
+  const FileList *files;
+  const BatchOptions *options;
+  FileResult *results;
+  WorkQueue *queues;
+  size_t worker_count;
+  pthread_mutex_t lock; // Guards results[].done and the fields below
+  pthread_cond_t finished;
+  size_t printed;  // Files printed so far, the next to print is results[printed]
+  size_t buffered; // Bytes held in results[].data
+  int ready;       // Set once the queues are filled
+};
+
+static int grow(char **buffer, size_t *capacity, size_t needed) {
+  size_t grown = *capacity ? *capacity : 4096;
+  char *resized;
+
+  while (grown < needed) {
+    grown *= 2;
+  }
+  if (grown == *capacity) {
+    return 0;
+  }
+  resized = realloc(*buffer, grown);
+  if (resized == NULL) {
+    return -1;
+  }
+  *buffer = resized;
+  *capacity = grown;
+  return 0;
+}
+
+/* SinkWrite for the worker's current FileResult: it's held until the file
+ * is the next to print, waiting if that would hold too much, then written
+ * out, along with all that comes after.
+ */
+static void write_result(void *context, const char *data, size_t size) {
+  Batch *batch = ((Worker *)context)->batch;
+  FileResult *result = ((Worker *)context)->result;
+  size_t index = (size_t)(result - batch->results);
+
+  if (result->failed) {
+    return;
+  }
+  if (!result->streaming) {
+    pthread_mutex_lock(&batch->lock);
+    while (batch->printed != index && batch->buffered + size > BATCH_BUFFER_LIMIT) {
+      pthread_cond_wait(&batch->finished, &batch->lock);
+    }
+    if (batch->printed == index) {
+      result->streaming = 1;
+      batch->buffered -= result->length;
+    } else {
+      batch->buffered += size;
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    // every file before this one is printed, and it's ours to print now
+    if (result->streaming && result->length > 0) {
+      fwrite(result->data, 1, result->length, stdout);
+      result->length = 0;
+    }
+  }
+  if (result->streaming) {
+    fwrite(data, 1, size, stdout);
+    return;
+  }
+
+  if (grow(&result->data, &result->capacity, result->length + size) != 0) {
+    pthread_mutex_lock(&batch->lock);
+    batch->buffered -= size;
+    pthread_mutex_unlock(&batch->lock);
+    result->failed = 1;
+    return;
+  }
+  memcpy(result->data + result->length, data, size);
+  result->length += size;
+}
+
+static void lex_one(Worker *worker, size_t index) {
+  const char *path = worker->batch->files->paths[index];
+  FileResult *result = &worker->batch->results[index];
+  SourceFile source;
+  Lexer lexer;
+  LineIndex lines;
+  Diagnostics diagnostics;
+  const BatchOptions *options = worker->batch->options;
+  CompactToken tokens[TOKEN_BATCH_SIZE];
+  size_t count;
+  size_t i;
+
+  worker->result = result;
+  if (source_open(&source, path, options->use_mmap, &worker->arena) != 0) {
+    result->missing = 1;
+    return;
+  }
+
+  sink_init(&worker->sink, write_result, worker, options->quiet);
+  worker->sink.errors_apart = options->errors_apart;
+  if (!options->quiet) {
+    sink_write(&worker->sink, "File: ", 6);
+    sink_write(&worker->sink, path, strlen(path));
+    sink_write(&worker->sink, "\n", 1);
+  }
+
+  lexer_init(&lexer, source.data, source.length);
+  lexer.options = options->lexer;
+  line_index_init(&lines, &worker->arena);
+  if (line_index_build(&lines, source.data, source.length) == 0) {
+    lexer.lines = &lines;
+  }
+  if (options->max_errors > 0 || options->errors_apart) {
+    diag_init(&diagnostics, &worker->arena, options->max_errors);
+    lexer.diagnostics = &diagnostics;
+  }
+  do {
+    count = lex_batch(&lexer, tokens, TOKEN_BATCH_SIZE);
+    for (i = 0; i < count; i++) {
+      sink_token(&worker->sink, tokens[i], source.data + tokens[i].offset, tokens[i].length);
+    }
+  } while (tokens[count - 1].type != TOKEN_EOF);
+  if (lexer.diagnostics != NULL) {
+    sink_diagnostics(&worker->sink, &diagnostics, source.data, options->errors_apart && !options->quiet);
+  }
+  sink_flush(&worker->sink);
+
+  result->tokens = worker->sink.tokens;
+  result->errors = worker->sink.errors;
+  source_close(&source);
+  arena_reset(&worker->arena);
+}
+
+/* Next file for a worker: its own front first, then another queue's back */
+static int take_file(Worker *worker, size_t *index) {
+  Batch *batch = worker->batch;
+  size_t n;
+
+  for (n = 0; n < batch->worker_count; n++) {
+    WorkQueue *queue = &batch->queues[(worker->id + n) % batch->worker_count];
+    int found = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->front < queue->back) {
+      *index = n == 0 ? queue->front++ : --queue->back;
+      found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    if (found) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void *run_worker(void *argument) {
+  Worker *worker = argument;
+  Batch *batch = worker->batch;
+  size_t index;
+
+  pthread_mutex_lock(&batch->lock);
+  while (!batch->ready) {
+    pthread_cond_wait(&batch->finished, &batch->lock);
+  }
+  pthread_mutex_unlock(&batch->lock);
+
+  while (take_file(worker, &index)) {
+    lex_one(worker, index);
+
+    pthread_mutex_lock(&batch->lock);
+    batch->results[index].done = 1;
+    pthread_cond_broadcast(&batch->finished);
+    pthread_mutex_unlock(&batch->lock);
+  }
+  return NULL;
+}
+
+/* Print one file's results, in the form lex_files documents */
+static void print_result(const char *path, const FileResult *result, int quiet) {
+  if (result->missing) {
+    printf("Error opening file %s\n", path);
+    return;
+  }
+  if (result->length > 0) {
+    fwrite(result->data, 1, result->length, stdout);
+  }
+  if (result->failed) {
+    printf("Memory allocation failed.\n");
+  } else if (quiet) {
+    printf("%s: %llu tokens, %llu errors\n", path, result->tokens, result->errors);
+  }
+}
+
+int lex_files(const FileList *files, const BatchOptions *options) {
+  Batch batch;
+  Worker *workers;
+  pthread_t *threads;
+  unsigned long long tokens = 0;
+  unsigned long long errors = 0;
+  size_t started;
+  size_t i;
+  int status = 0;
+
+  batch.files = files;
+  batch.options = options;
+  batch.worker_count = options->jobs > 0 ? (size_t)options->jobs : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+  if (batch.worker_count == 0 || batch.worker_count > files->count) {
+    batch.worker_count = files->count > 0 ? files->count : 1;
+  }
+
+  batch.results = calloc(files->count, sizeof(FileResult));
+  batch.queues = calloc(batch.worker_count, sizeof(WorkQueue));
+  workers = calloc(batch.worker_count, sizeof(Worker));
+  threads = calloc(batch.worker_count, sizeof(pthread_t));
+  if ((files->count > 0 && batch.results == NULL) || !batch.queues || !workers || !threads) {
+    free(batch.results);
+    free(batch.queues);
+    free(workers);
+    free(threads);
+    printf("Memory allocation failed.\n");
+    return 1;
+  }
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.finished, NULL);
+  batch.printed = 0;
+  batch.buffered = 0;
+  batch.ready = 0;
+
+  for (i = 0; i < batch.worker_count; i++) {
+    pthread_mutex_init(&batch.queues[i].lock, NULL);
+    workers[i].batch = &batch;
+    workers[i].id = i;
+    arena_init(&workers[i].arena);
+  }
+  for (started = 0; started < batch.worker_count; started++) {
+    if (pthread_create(&threads[started], NULL, run_worker, &workers[started]) != 0) {
+      break;
+    }
+  }
+
+  // each worker that started gets a contiguous run of files. None are left
+  // to a worker that didn't, so the next file to print is always taken by
+  // a worker that can't be waiting on a later one
+  pthread_mutex_lock(&batch.lock);
+  if (started > 0) {
+    batch.worker_count = started;
+  }
+  for (i = 0; i < batch.worker_count; i++) {
+    batch.queues[i].front = i * files->count / batch.worker_count;
+    batch.queues[i].back = (i + 1) * files->count / batch.worker_count;
+  }
+  batch.ready = 1;
+  pthread_cond_broadcast(&batch.finished);
+  pthread_mutex_unlock(&batch.lock);
+
+  // print each file as soon as it and every file before it are done
+  for (i = 0; i < files->count; i++) {
+    FileResult *result = &batch.results[i];
+
+    // if no thread could start, lex each file here when its turn comes
+    if (started == 0) {
+      lex_one(&workers[0], i);
+      result->done = 1;
+    }
+    pthread_mutex_lock(&batch.lock);
+    while (!result->done) {
+      pthread_cond_wait(&batch.finished, &batch.lock);
+    }
+    pthread_mutex_unlock(&batch.lock);
+
+    print_result(files->paths[i], result, options->quiet);
+    tokens += result->tokens;
+    errors += result->errors;
+    if (result->missing || result->failed) {
+      status = 1;
+    }
+    free(result->data);
+    result->data = NULL;
+
+    pthread_mutex_lock(&batch.lock);
+    batch.buffered -= result->length;
+    batch.printed = i + 1;
+    pthread_cond_broadcast(&batch.finished);
+    pthread_mutex_unlock(&batch.lock);
+  }
+
+  for (i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  if (options->quiet) {
+    printf("Tokens: %llu\nErrors: %llu\n", tokens, errors);
+  }
+
+  for (i = 0; i < batch.worker_count; i++) {
+    pthread_mutex_destroy(&batch.queues[i].lock);
+    arena_free(&workers[i].arena);
+  }
+  pthread_mutex_destroy(&batch.lock);
+  pthread_cond_destroy(&batch.finished);
+  free(batch.results);
+  free(batch.queues);
+  free(workers);
+  free(threads);
+  return status;
+}
+
+static int add_path(FileList *files, const char *path) {
+  char *copy;
+
+  if (files->count == files->capacity) {
+    size_t capacity = files->capacity ? files->capacity * 2 : 64;
+    char **paths = realloc(files->paths, capacity * sizeof(char *));
+
+    if (paths == NULL) {
+      return -1;
+    }
+    files->paths = paths;
+    files->capacity = capacity;
+  }
+  copy = malloc(strlen(path) + 1);
+  if (copy == NULL) {
+    return -1;
+  }
+  strcpy(copy, path);
+  files->paths[files->count++] = copy;
+  return 0;
+}
+
+int is_directory(const char *path) {
+  struct stat info;
+
+  return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int file_list_add(FileList *files, const char *path) {
+  struct stat info;
+  DIR *dir;
+  struct dirent *entry;
+  FileList names = {NULL, 0, 0};
+  size_t i;
+  int status = 0;
+
+  // a path that can't be read is still listed, and reported when it's lexed
+  if (stat(path, &info) != 0 || !S_ISDIR(info.st_mode)) {
+    return add_path(files, path);
+  }
+
+  // read the whole directory first so its entries can be sorted
+  dir = opendir(path);
+  if (dir == NULL) {
+    return -1;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.' && add_path(&names, entry->d_name) != 0) {
+      status = -1;
+      break;
+    }
+  }
+  closedir(dir);
+  qsort(names.paths, names.count, sizeof(char *), compare_names);
+
+  for (i = 0; i < names.count && status == 0; i++) {
+    size_t length = strlen(path);
+    char *child = malloc(length + strlen(names.paths[i]) + 2);
+
+    if (child == NULL) {
+      status = -1;
+      break;
+    }
+    strcpy(child, path);
+    if (length > 0 && path[length - 1] != '/') {
+      strcat(child, "/");
+    }
+    strcat(child, names.paths[i]);
+    // only plain files and directories, symlinks are left out so a link
+    // back up the tree can't loop
+    if (lstat(child, &info) == 0 && (S_ISDIR(info.st_mode) || S_ISREG(info.st_mode))) {
+      status = file_list_add(files, child);
+    }
+    free(child);
+  }
+
+  file_list_free(&names);
+  return status;
+}
+
+void file_list_free(FileList *files) {
+  size_t i;
+
+  for (i = 0; i < files->count; i++) {
+    free(files->paths[i]);
+  }
+  free(files->paths);
+  files->paths = NULL;
+  files->count = 0;
+  files->capacity = 0;
+}
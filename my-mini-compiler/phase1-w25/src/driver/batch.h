@@ -0,0 +1,47 @@
+/* batch.h */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "../../include/lexer.h"
+#include <stddef.h>
+
+/* How lex_files runs */
+typedef struct {
+  int jobs;     // Worker threads, 0 for one per CPU
+  int use_mmap; // Passed to source_open
+  int quiet;    // Print per-file counts instead of tokens
+  LexerOptions lexer; // Options every file is lexed with
+  size_t max_errors;  // Stop lexing a file after this many errors, 0 for no limit
+  int errors_apart;   // Print each file's errors after its tokens, as diagnostics
+} BatchOptions;
+
+/* A growable list of file paths, each owned by the list */
+typedef struct {
+  char **paths;
+  size_t count;
+  size_t capacity;
+} FileList;
+
+/* Add path to files, or if it's a directory every regular file under it, in
+ * name order and skipping names that start with '.'.
+ * Returns 0 on success, -1 if a directory can't be read or memory runs out.
+ */
+int file_list_add(FileList *files, const char *path);
+
+void file_list_free(FileList *files);
+
+/* 1 if path names a directory */
+int is_directory(const char *path);
+
+/* Lex every file on a pool of worker threads and print the results in list
+ * order, so the output is the same whatever the number of threads. Each
+ * file's tokens follow a "File: path" line, and its diagnostics (see
+ * sink_diagnostics) follow them; in quiet mode each file gets one line of
+ * counts and the totals come last. The file next in order is printed as it
+ * is lexed, and the output held for files after it is limited, so workers
+ * that get too far ahead wait for it.
+ * Returns 0 if every file was lexed, 1 if any couldn't be.
+ */
+int lex_files(const FileList *files, const BatchOptions *options);
+
+#endif /* BATCH_H */
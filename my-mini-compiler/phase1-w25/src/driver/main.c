@@ -0,0 +1,468 @@
+/* main.c */
+#include "batch.h"
+#include "../../include/lexer.h"
+#include "../../include/diag.h"
+#include "../../include/lineindex.h"
+#include "../../include/parallel.h"
+#include "../../include/sink.h"
+#include "../../include/source.h"
+#include "../../include/stream.h"
+#include "../../include/symtab.h"
+#include "../../include/tokfile.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOKEN_BATCH_SIZE 256
+
+static TokenSink sink;
+static TokenFileWriter *binary; // Where tokens go instead of sink, if set
+static SymbolTable *symbols;    // Identifiers and strings are interned here, if set
+static Arena arena;             // Memory that lasts the whole run
+static LexerOptions options;    // Options every lexer gets
+static Diagnostics *diagnostics; // Errors are gathered here, and can stop lexing early, if set
+
+static void print_raw(TokenSink *out, const char *buffer, size_t length) {
+  const char *end = buffer + length;
+  const char *run = buffer;
+
+  // copy plain bytes a run at a time, escaping the ones that aren't
+  while (buffer < end) {
+    const char *escape;
+
+    switch (*buffer) {
+    case '\n':
+      escape = "\\n";
+      break;
+    case '\t':
+      escape = "\\t";
+      break;
+    case '\r':
+      escape = "\\r";
+      break;
+    case '\0':
+      escape = "\\0";
+      break;
+    default:
+      buffer++;
+      continue;
+    }
+    sink_write(out, run, buffer - run);
+    sink_write(out, escape, 2);
+    run = ++buffer;
+  }
+  sink_write(out, run, buffer - run);
+  sink_write(out, "\n\n", 2);
+}
+
+/* Print the totals a quiet sink collected */
+static void print_counts(const TokenSink *out) {
+  printf("Tokens: %llu\nErrors: %llu\n", out->tokens, out->errors);
+  if (symbols != NULL) {
+    printf("Symbols: %zu\n", symbols->count);
+  }
+}
+
+/* Send one token to the token file if one is being written, else the sink */
+static int emit_token(CompactToken token, const char *text, size_t text_length) {
+  if (binary != NULL) {
+    return tokfile_add(binary, token, text, text_length);
+  }
+  sink_token(&sink, token, text, text_length);
+  return 0;
+}
+
+/* Lex a file (or stdin) chunk by chunk, without loading all of it */
+static int lex_stream(FILE *file, size_t chunk_size) {
+  StreamLexer stream;
+  CompactToken token;
+
+  if (stream_lexer_init(&stream, stream_read_file, file, chunk_size) != 0) {
+    printf("Memory allocation failed.\n");
+    return 1;
+  }
+  stream.lexer.symbols = symbols;
+  stream.lexer.options = options;
+
+  do {
+    token = stream_next_token(&stream);
+    if (emit_token(token, stream.text, stream.text_length) != 0) {
+      stream.failed = 1;
+      break;
+    }
+  } while (token.type != TOKEN_EOF);
+
+  stream_lexer_free(&stream);
+  if (stream.failed) {
+    printf("Memory allocation failed.\n");
+    return 1;
+  }
+  if (stream.too_long) {
+    sink_flush(&sink);
+    printf("Input too long, only its first 4 GiB were lexed\n");
+    return 1;
+  }
+  return 0;
+}
+
+/* Lex a whole file in place, split across jobs threads if split is set */
+static int lex_file(const char *path, int use_mmap, int echo, int split, int jobs) {
+  SourceFile source;
+  Lexer lexer;
+  LineIndex lines;
+  CompactToken tokens[TOKEN_BATCH_SIZE];
+  size_t count;
+  size_t i;
+
+  // map the file and lex it in place, carriage returns are skipped as
+  // whitespace so the buffer is never rewritten
+  if (source_open(&source, path, use_mmap, &arena) != 0) {
+    printf("Error opening file\n");
+    return 1;
+  }
+
+  if (echo) {
+    // printed as a C string, so it stops at a NUL byte
+    const char *nul = memchr(source.data, '\0', source.length);
+
+    print_raw(&sink, source.data, source.length);
+    sink_write(&sink, "Analyzing input:\n", 17);
+    sink_write(&sink, source.data, nul ? (size_t)(nul - source.data) : source.length);
+    sink_write(&sink, "\n\n", 2);
+  }
+
+  lexer_init(&lexer, source.data, source.length);
+  lexer.symbols = symbols;
+  lexer.options = options;
+
+  // segments can't stop at an error limit, so with diagnostics the file is
+  // lexed in one go
+  if (split && diagnostics == NULL) {
+    CompactToken *all = lex_parallel(source.data, source.length, lexer.options, jobs, &count);
+
+    // segments are lexed without a symbol table, names are interned here
+    for (i = 0; all != NULL && i < count; i++) {
+      if (symbols != NULL && (all[i].type == TOKEN_IDENTIFIER || all[i].type == TOKEN_STRING)) {
+        all[i].id = symtab_intern(symbols, source.data + all[i].offset, all[i].length);
+      }
+      if (emit_token(all[i], source.data + all[i].offset, all[i].length) != 0) {
+        break;
+      }
+    }
+    if (all == NULL || i < count) {
+      printf("Memory allocation failed.\n");
+    }
+    free(all);
+    source_close(&source);
+    return all == NULL || i < count;
+  }
+
+  // find every line up front so the lexer looks lines up instead of
+  // counting them; if there's no memory for that it still can
+  line_index_init(&lines, &arena);
+  if (line_index_build(&lines, source.data, source.length) == 0) {
+    lexer.lines = &lines;
+  }
+  lexer.diagnostics = diagnostics;
+
+  // lex a block of tokens at a time until the block that ends with EOF
+  do {
+    count = lex_batch(&lexer, tokens, TOKEN_BATCH_SIZE);
+    for (i = 0; i < count; i++) {
+      if (emit_token(tokens[i], source.data + tokens[i].offset, tokens[i].length) != 0) {
+        printf("Memory allocation failed.\n");
+        source_close(&source);
+        return 1;
+      }
+    }
+  } while (tokens[count - 1].type != TOKEN_EOF);
+
+  if (diagnostics != NULL) {
+    sink_diagnostics(&sink, diagnostics, source.data, sink.errors_apart && !sink.quiet);
+  }
+  source_close(&source);
+  return 0;
+}
+
+/* Print the tokens saved in a token file, as if they had just been lexed */
+static int read_binary(const char *path) {
+  SourceFile source;
+  TokenFile file;
+  TokenFileCursor cursor;
+  CompactToken token;
+  const char *text;
+  size_t text_length;
+  int status;
+
+  if (source_open(&source, path, 1, &arena) != 0) {
+    printf("Error opening file\n");
+    return 1;
+  }
+  if (tokfile_open(&file, source.data, source.length) != 0) {
+    printf("Not a token file\n");
+    source_close(&source);
+    return 1;
+  }
+
+  tokfile_cursor_init(&cursor, &file);
+  while ((status = tokfile_next(&cursor, &token, &text, &text_length)) > 0) {
+    sink_token(&sink, token, text, text_length);
+  }
+
+  source_close(&source);
+  if (status < 0) {
+    sink_flush(&sink);
+    printf("Corrupt token file\n");
+    return 1;
+  }
+  return 0;
+}
+
+// This is a basic lexer that handles numbers (e.g., "123", "456"), basic
+// operators (+ and -), consecutive operator errors, whitespace and newlines,
+// with simple line tracking for error reporting.
+
+static void usage(void) {
+  printf("usage: my-mini-compiler [--no-mmap] [--stream] [--chunk BYTES]\n"
+         "                        [--no-echo] [--quiet] [--emit-binary OUT]\n"
+         "                        [--read-binary] [--jobs N] [--split] [--intern]\n"
+         "                        [--max-lexeme N] [--max-errors N] [--diagnostics]\n"
+         "                        [--utf8] [--identifiers c11|ascii|any]\n"
+         "                        [file... | dir... | -]\n"
+         "  --no-echo         don't print the input before its tokens\n"
+         "  --quiet           print only the token and error counts\n"
+         "  --no-mmap         read the file instead of mapping it\n"
+         "  --stream          lex the file in chunks of BYTES (--chunk, 64K by default)\n"
+         "  --emit-binary     save the tokens to OUT as a token file instead of printing them\n"
+         "  --read-binary     print the tokens of such a token file\n"
+         "  --jobs            lex several files, or a directory, on N threads (one per CPU\n"
+         "                    by default)\n"
+         "  --split           lex a single large file on the --jobs threads instead\n"
+         "  --intern          give identifiers and strings symbol IDs; --quiet counts them\n"
+         "  --max-lexeme      limit the length of every kind of token, 0 for no limit\n"
+         "  --max-errors      stop lexing a file after N errors\n"
+         "  --diagnostics     print a file's errors, with columns and codes, after its tokens\n"
+         "  --utf8            lex the input as UTF-8, allowing the --identifiers characters\n"
+         "                    (C11's by default) in identifiers\n"
+         "A - reads stdin as a stream. --max-errors and --diagnostics need a file, and\n"
+         "--emit-binary, --read-binary, --stream, --split and --intern a single one.\n");
+}
+
+/* The whole number from min to max that option's value text spells, or -1
+ * after printing what's wrong with it and the usage
+ */
+static long parse_number(const char *option, const char *text, long min, long max) {
+  char *end;
+  long value;
+
+  errno = 0;
+  value = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || errno == ERANGE || value < min || value > max) {
+    printf("%s takes a whole number from %ld up, not %s\n", option, min, text);
+    usage();
+    return -1;
+  }
+  return value;
+}
+
+int main(int argc, char **argv) {
+  // const char *input = "123 + 456 - 789\n1 ++ 2"; // Test with multi-line
+  // input
+
+  // Test comments, keywords, identifiers
+  // const char *input =
+  //"// This is a comment \n /* Multi-line \n comment */ int x";
+
+  const char *path = "../../test/input_invalid.txt";
+  const char *binary_path = NULL;
+  int use_mmap = 1;
+  int use_stream = 0;
+  int from_binary = 0;
+  int path_count = 0;
+  BatchOptions batch = {0, 1, 0, {0}, 0, 0};
+  int use_batch = 0;
+  int split = 0;
+  int echo = 1;
+  int quiet = 0;
+  int errors_apart = 0;
+  size_t max_errors = 0;
+  int status;
+  size_t chunk_size = 64 * 1024;
+  TokenFileWriter writer;
+  SymbolTable symbol_table;
+  Diagnostics diagnostic_buffer;
+  long value;
+  int i;
+
+  options = lexer_default_options();
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--no-echo") == 0) {
+      echo = 0;
+    } else if (strcmp(argv[i], "--quiet") == 0) {
+      quiet = 1;
+      echo = 0;
+    } else if (strcmp(argv[i], "--no-mmap") == 0) {
+      use_mmap = 0;
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      use_stream = 1;
+    } else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+      if ((value = parse_number(argv[i], argv[i + 1], 1, LONG_MAX)) < 0) {
+        return 1;
+      }
+      chunk_size = (size_t)value;
+      i++;
+    } else if (strcmp(argv[i], "--emit-binary") == 0 && i + 1 < argc) {
+      binary_path = argv[++i];
+      echo = 0;
+    } else if (strcmp(argv[i], "--read-binary") == 0) {
+      from_binary = 1;
+      echo = 0;
+    } else if (strcmp(argv[i], "--intern") == 0) {
+      symbols = &symbol_table;
+    } else if (strcmp(argv[i], "--max-lexeme") == 0 && i + 1 < argc) {
+      if ((value = parse_number(argv[i], argv[i + 1], 0, LONG_MAX)) < 0) {
+        return 1;
+      }
+      lexer_set_limits(&options, (size_t)value);
+      i++;
+    } else if (strcmp(argv[i], "--max-errors") == 0 && i + 1 < argc) {
+      if ((value = parse_number(argv[i], argv[i + 1], 0, LONG_MAX)) < 0) {
+        return 1;
+      }
+      max_errors = (size_t)value;
+      i++;
+    } else if (strcmp(argv[i], "--utf8") == 0) {
+      options.utf8 = 1;
+    } else if (strcmp(argv[i], "--identifiers") == 0 && i + 1 < argc) {
+      const char *policy = argv[++i];
+
+      if (strcmp(policy, "c11") == 0) {
+        options.identifiers = IDENTIFIERS_C11;
+      } else if (strcmp(policy, "ascii") == 0) {
+        options.identifiers = IDENTIFIERS_ASCII;
+      } else if (strcmp(policy, "any") == 0) {
+        options.identifiers = IDENTIFIERS_ANY;
+      } else {
+        printf("--identifiers takes c11, ascii or any\n");
+        usage();
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--diagnostics") == 0) {
+      errors_apart = 1;
+    } else if (strcmp(argv[i], "--split") == 0) {
+      split = 1;
+    } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+      if ((value = parse_number(argv[i], argv[i + 1], 0, INT_MAX)) < 0) {
+        return 1;
+      }
+      batch.jobs = (int)value;
+      use_batch = 1;
+      i++;
+    } else if (strcmp(argv[i], "--help") == 0) {
+      usage();
+      return 0;
+    } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+      // an unknown option, or one missing its value
+      printf("Unknown option, or missing value: %s\n", argv[i]);
+      usage();
+      return 1;
+    } else {
+      // inputs are gathered at the front of argv
+      argv[path_count++] = argv[i];
+    }
+  }
+  if (path_count > 0) {
+    path = argv[0];
+  }
+
+  if (path_count > 1 || (use_batch && !split) || is_directory(path)) {
+    FileList files = {NULL, 0, 0};
+
+    if (binary_path != NULL || from_binary || use_stream || split || symbols != NULL) {
+      printf("--emit-binary, --read-binary, --stream, --split and --intern take a single file\n");
+      return 1;
+    }
+    batch.use_mmap = use_mmap;
+    batch.quiet = quiet;
+    batch.lexer = options;
+    batch.max_errors = max_errors;
+    batch.errors_apart = errors_apart;
+    for (i = 0; i < path_count || (path_count == 0 && i == 0); i++) {
+      if (file_list_add(&files, path_count > 0 ? argv[i] : path) != 0) {
+        printf("Error opening file %s\n", path_count > 0 ? argv[i] : path);
+        file_list_free(&files);
+        return 1;
+      }
+    }
+    status = lex_files(&files, &batch);
+    file_list_free(&files);
+    return status;
+  }
+
+  if ((max_errors > 0 || errors_apart) && (use_stream || strcmp(path, "-") == 0)) {
+    printf("--max-errors and --diagnostics need a file, not a stream\n");
+    return 1;
+  }
+
+  sink_init(&sink, sink_write_file, stdout, quiet);
+  arena_init(&arena);
+  symtab_init(&symbol_table, &arena);
+  if (max_errors > 0 || errors_apart) {
+    diag_init(&diagnostic_buffer, &arena, max_errors);
+    diagnostics = &diagnostic_buffer;
+    sink.errors_apart = errors_apart;
+  }
+  if (binary_path != NULL) {
+    if (tokfile_writer_init(&writer) != 0) {
+      printf("Memory allocation failed.\n");
+      return 1;
+    }
+    binary = &writer;
+  }
+
+  if (from_binary) {
+    status = read_binary(path);
+  } else if (strcmp(path, "-") == 0) {
+    // stdin, or anything too big to hold, is lexed as a stream
+    status = lex_stream(stdin, chunk_size);
+  } else if (use_stream) {
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+      printf("Error opening file\n");
+      return 1;
+    }
+    status = lex_stream(file, chunk_size);
+    fclose(file);
+  } else {
+    status = lex_file(path, use_mmap, echo, split, batch.jobs);
+  }
+
+  if (binary != NULL) {
+    sink_flush(&sink);
+    if (status == 0) {
+      FILE *out = fopen(binary_path, "wb");
+
+      if (out == NULL || tokfile_write(binary, out) != 0) {
+        printf("Error writing file\n");
+        status = 1;
+      }
+      if (out != NULL) {
+        fclose(out);
+      }
+    }
+    tokfile_writer_free(binary);
+    arena_free(&arena);
+    return status;
+  }
+
+  sink_flush(&sink);
+  if (quiet && status == 0) {
+    print_counts(&sink);
+  }
+  arena_free(&arena);
+  return status;
+}
@@ -0,0 +1,114 @@
+/* arena.c */
+#include "../../include/arena.h"
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct ArenaBlock {
+  ArenaBlock *next;
+  size_t size; // Bytes of data
+  alignas(max_align_t) unsigned char data[];
+};
+
+void arena_init(Arena *arena) {
+  arena->first = NULL;
+  arena->current = NULL;
+  arena->used = 0;
+}
+
+/* Move on to a block after the current one with room for size bytes
+ * The next block is reused if it's big enough; if it isn't it is freed and
+ * replaced, so the chain never grows past what one run needs.
+ */
+static int next_block(Arena *arena, size_t size) {
+  ArenaBlock **link = arena->current ? &arena->current->next : &arena->first;
+  ArenaBlock *block = *link;
+
+  if (block == NULL || block->size < size) {
+    ArenaBlock *next = block ? block->next : NULL;
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+    if (block_size > (size_t)-1 - sizeof(ArenaBlock)) {
+      return -1;
+    }
+    free(block);
+    *link = next; // keep the chain whole even if malloc fails
+    block = malloc(sizeof(ArenaBlock) + block_size);
+    if (block == NULL) {
+      return -1;
+    }
+    block->next = next;
+    block->size = block_size;
+    *link = block;
+  }
+
+  arena->current = block;
+  arena->used = 0;
+  return 0;
+}
+
+/* size bytes at a multiple of align from the start of a block */
+static void *take(Arena *arena, size_t size, size_t align) {
+  size_t start = arena->current ? (arena->used + align - 1) & ~(align - 1) : 0;
+  void *data;
+
+  if (arena->current == NULL || start > arena->current->size || arena->current->size - start < size) {
+    if (next_block(arena, size) != 0) {
+      return NULL;
+    }
+    start = 0;
+  }
+  data = arena->current->data + start;
+  arena->used = start + size;
+  return data;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  return take(arena, size, ARENA_ALIGN);
+}
+
+char *arena_copy(Arena *arena, const char *data, size_t size) {
+  char *copy = take(arena, size, 1);
+
+  if (copy != NULL) {
+    memcpy(copy, data, size);
+  }
+  return copy;
+}
+
+void *arena_grow(Arena *arena, void *old, size_t old_size, size_t new_size) {
+  ArenaBlock *block = arena->current;
+  void *grown;
+
+  if (old != NULL && block != NULL && old_size <= arena->used &&
+      (unsigned char *)old == block->data + arena->used - old_size &&
+      block->size - (arena->used - old_size) >= new_size) {
+    arena->used = arena->used - old_size + new_size;
+    return old;
+  }
+
+  grown = take(arena, new_size, ARENA_ALIGN);
+  if (grown != NULL && old_size > 0) {
+    memcpy(grown, old, old_size);
+  }
+  return grown;
+}
+
+void arena_reset(Arena *arena) {
+  arena->current = arena->first;
+  arena->used = 0;
+}
+
+void arena_free(Arena *arena) {
+  ArenaBlock *block = arena->first;
+
+  while (block != NULL) {
+    ArenaBlock *next = block->next;
+
+    free(block);
+    block = next;
+  }
+  arena_init(arena);
+}
@@ -0,0 +1,38 @@
+/* charclass.h */
+#ifndef CHARCLASS_H
+#define CHARCLASS_H
+
+/* Character classes used by the recognizers in lexer.c and scan.c
+ * One table lookup replaces isdigit/isalpha and the long chains of c != ...
+ * comparisons, and doesn't depend on the locale. Which bytes start or end
+ * a token is tokens.spec's to say, so those classes live there.
+ */
+#define CC_DIGIT 0x01      // 0-9
+#define CC_IDENT_CONT 0x02 // Can continue an identifier
+#define CC_WHITESPACE 0x04 // Skipped between tokens
+
+#define CC_LETTER CC_IDENT_CONT
+#define CC_NUMERAL (CC_DIGIT | CC_IDENT_CONT)
+
+static const unsigned char char_class[256] = {
+    // whitespace (\r for Windows line endings)
+    [' '] = CC_WHITESPACE, ['\t'] = CC_WHITESPACE, ['\r'] = CC_WHITESPACE, ['\n'] = CC_WHITESPACE,
+    // digits
+    ['0'] = CC_NUMERAL, ['1'] = CC_NUMERAL, ['2'] = CC_NUMERAL, ['3'] = CC_NUMERAL, ['4'] = CC_NUMERAL,
+    ['5'] = CC_NUMERAL, ['6'] = CC_NUMERAL, ['7'] = CC_NUMERAL, ['8'] = CC_NUMERAL, ['9'] = CC_NUMERAL,
+    // letters and underscore
+    ['a'] = CC_LETTER, ['b'] = CC_LETTER, ['c'] = CC_LETTER, ['d'] = CC_LETTER, ['e'] = CC_LETTER, ['f'] = CC_LETTER, ['g'] = CC_LETTER,
+    ['h'] = CC_LETTER, ['i'] = CC_LETTER, ['j'] = CC_LETTER, ['k'] = CC_LETTER, ['l'] = CC_LETTER, ['m'] = CC_LETTER, ['n'] = CC_LETTER,
+    ['o'] = CC_LETTER, ['p'] = CC_LETTER, ['q'] = CC_LETTER, ['r'] = CC_LETTER, ['s'] = CC_LETTER, ['t'] = CC_LETTER, ['u'] = CC_LETTER,
+    ['v'] = CC_LETTER, ['w'] = CC_LETTER, ['x'] = CC_LETTER, ['y'] = CC_LETTER, ['z'] = CC_LETTER,
+    ['A'] = CC_LETTER, ['B'] = CC_LETTER, ['C'] = CC_LETTER, ['D'] = CC_LETTER, ['E'] = CC_LETTER, ['F'] = CC_LETTER, ['G'] = CC_LETTER,
+    ['H'] = CC_LETTER, ['I'] = CC_LETTER, ['J'] = CC_LETTER, ['K'] = CC_LETTER, ['L'] = CC_LETTER, ['M'] = CC_LETTER, ['N'] = CC_LETTER,
+    ['O'] = CC_LETTER, ['P'] = CC_LETTER, ['Q'] = CC_LETTER, ['R'] = CC_LETTER, ['S'] = CC_LETTER, ['T'] = CC_LETTER, ['U'] = CC_LETTER,
+    ['V'] = CC_LETTER, ['W'] = CC_LETTER, ['X'] = CC_LETTER, ['Y'] = CC_LETTER, ['Z'] = CC_LETTER,
+    ['_'] = CC_LETTER,
+};
+
+/* Class bits of character c */
+#define CHAR_CLASS(c) (char_class[(unsigned char)(c)])
+
+#endif /* CHARCLASS_H */
@@ -0,0 +1,171 @@
+/* counters.h */
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+/* Counting hooks for lexer.c and the lexers built on it, see stats.h; only
+ * compiled with LEXER_STATS
+ */
+#ifdef LEXER_STATS
+
+#include "../../include/tokens.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define STATS_UNIT "cycles"
+#else
+#include <time.h>
+#define STATS_UNIT "ns"
+#endif
+
+/* What a token is counted as, by the recognizer that produced it */
+typedef enum {
+  BRANCH_WHITESPACE, // Runs of whitespace skipped before a token
+  BRANCH_LINE_COMMENT,
+  BRANCH_BLOCK_COMMENT,
+  BRANCH_NUMBER,
+  BRANCH_KEYWORD,
+  BRANCH_IDENTIFIER,
+  BRANCH_STRING,
+  BRANCH_OPERATOR,
+  BRANCH_DELIMITER,
+  BRANCH_INVALID,
+  BRANCH_EOF,
+  BRANCH_RELEXED, // Tokens scanned, then thrown away to be scanned again
+  BRANCH_COUNT
+} Branch;
+
+typedef struct {
+  uint64_t tokens;
+  uint64_t bytes;
+  uint64_t time; // In STATS_UNIT
+} BranchCounts;
+
+typedef struct {
+  BranchCounts branch[BRANCH_COUNT];
+  uint64_t errors[16]; // By ErrorType, which fits the 4 bits CompactToken gives it
+  uint64_t mark;       // When the current token's whitespace was skipped
+  int registered;      // This thread's counts get added to the totals when it ends
+} Counters;
+
+extern _Thread_local Counters counters;
+
+/* Arrange for this thread's counters to be added to the totals */
+void counters_register(void);
+
+static inline uint64_t stats_clock(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  return __rdtsc();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* Call once whitespace has been skipped */
+#define STATS_MARK() (counters.mark = stats_clock())
+
+/* The recognizer a token is counted against; resumed is set if the call
+ * finished a block comment from an earlier input
+ */
+static inline Branch branch_of(CompactToken token, const char *input, int resumed) {
+  switch (token.type) {
+  case TOKEN_COMMENT:
+    return !resumed && input[token.offset + 1] == '/' ? BRANCH_LINE_COMMENT : BRANCH_BLOCK_COMMENT;
+  case TOKEN_NUMBER:
+    return BRANCH_NUMBER;
+  case TOKEN_KEYWORD:
+    return BRANCH_KEYWORD;
+  case TOKEN_IDENTIFIER:
+    return BRANCH_IDENTIFIER;
+  case TOKEN_STRING:
+    return BRANCH_STRING;
+  case TOKEN_OPERATOR:
+    return BRANCH_OPERATOR;
+  case TOKEN_DELIMITER:
+    return BRANCH_DELIMITER;
+  case TOKEN_EOF:
+    return BRANCH_EOF;
+  default:
+    return token.error == ERROR_CONSECUTIVE_OPERATORS ? BRANCH_OPERATOR : BRANCH_INVALID;
+  }
+}
+
+/* Count a token that was scanned from start between begin and end */
+static inline void count_token(CompactToken token, const char *input, size_t start, int resumed, uint64_t begin,
+                               uint64_t end) {
+  Branch branch = branch_of(token, input, resumed);
+
+  if (!counters.registered) {
+    counters_register();
+  }
+  if (!resumed && token.offset > start) {
+    counters.branch[BRANCH_WHITESPACE].tokens++;
+    counters.branch[BRANCH_WHITESPACE].bytes += token.offset - start;
+  }
+  counters.branch[BRANCH_WHITESPACE].time += counters.mark - begin;
+
+  counters.branch[branch].tokens++;
+  counters.branch[branch].bytes += token.length;
+  counters.branch[branch].time += end - counters.mark;
+  counters.errors[token.error]++;
+}
+
+/* Take back a token counted earlier that is being thrown away to be
+ * scanned again (a stream window that grew, a parallel segment that
+ * guessed wrong, a cursor reset): it and the whitespace before it move to
+ * BRANCH_RELEXED, though its time stays in the rows that spent it. Another
+ * thread may have counted it, the totals still come out right.
+ */
+static inline void uncount_token(CompactToken token, const char *input, size_t start, int resumed) {
+  Branch branch = branch_of(token, input, resumed);
+
+  if (!counters.registered) {
+    counters_register();
+  }
+  if (!resumed && token.offset > start) {
+    counters.branch[BRANCH_WHITESPACE].tokens--;
+    counters.branch[BRANCH_WHITESPACE].bytes -= token.offset - start;
+  }
+  counters.branch[branch].tokens--;
+  counters.branch[branch].bytes -= token.length;
+  counters.errors[token.error]--;
+  counters.branch[BRANCH_RELEXED].tokens++;
+  counters.branch[BRANCH_RELEXED].bytes += token.length;
+}
+
+/* A piece of a block comment or run of invalid characters the stream lexer
+ * follows from window to window (see stream.c), which was counted as a
+ * token of its own against branch: only the whole token is one, with one
+ * error (count_whole_error adds it once the token is whole), and given_back
+ * bytes at the piece's end are scanned again with the next piece
+ */
+static inline void count_piece(Branch branch, ErrorType error, size_t given_back, int first) {
+  if (!first) {
+    counters.branch[branch].tokens--;
+  }
+  counters.branch[branch].bytes -= given_back;
+  counters.errors[error]--;
+}
+
+static inline void count_whole_error(ErrorType error) {
+  counters.errors[error]++;
+}
+
+#define STATS_UNCOUNT(token, input, start, resumed) uncount_token(token, input, start, resumed)
+#define STATS_PIECE(branch, error, given_back, first) count_piece(branch, error, given_back, first)
+#define STATS_WHOLE_ERROR(error) count_whole_error(error)
+
+#else
+#define STATS_MARK() ((void)0)
+// the arguments are still evaluated, so nothing goes unused without stats
+// (but for a Branch, which only exists with them)
+#define STATS_UNCOUNT(token, input, start, resumed) ((void)(token), (void)(input), (void)(start), (void)(resumed))
+#define STATS_PIECE(branch, error, given_back, first) ((void)(error), (void)(given_back), (void)(first))
+#define STATS_WHOLE_ERROR(error) ((void)(error))
+#endif /* LEXER_STATS */
+
+#endif /* COUNTERS_H */
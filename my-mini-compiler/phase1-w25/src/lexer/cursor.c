@@ -0,0 +1,104 @@
+/* cursor.c */
+#include "../../include/cursor.h"
+#include "counters.h"
+
+void cursor_init(TokenCursor *cursor, Lexer *lexer) {
+  cursor->lexer = lexer;
+  cursor->head = 0;
+  cursor->first = 0;
+  cursor->tail = 0;
+  cursor->lexed = 0;
+}
+
+/* Where the lexer is now, as a mark for the next token it lexes */
+static void save_state(const TokenCursor *cursor, CursorMark *mark) {
+  const Lexer *lexer = cursor->lexer;
+
+  mark->index = cursor->tail;
+  mark->pos = lexer->pos;
+  mark->line_start = lexer->line_start;
+  mark->line = lexer->line;
+  mark->in_comment = lexer->in_comment;
+  mark->last_token_type = lexer->last_token_type;
+}
+
+/* Lex one more token into the ring, dropping the oldest if it's full */
+static void lex_one(TokenCursor *cursor) {
+  Lexer *lexer = cursor->lexer;
+  struct Diagnostics *diagnostics = lexer->diagnostics;
+  size_t slot = cursor->tail % CURSOR_LOOKAHEAD;
+  CompactToken token;
+
+  save_state(cursor, &cursor->starts[slot]);
+
+  if (cursor->tail < cursor->lexed) {
+    // a token lexed again after a reset already has its diagnostic, and
+    // was counted the first time (so were any comments skipped before it)
+    lexer->diagnostics = NULL;
+    do {
+      size_t start = lexer->pos;
+      int resumed = lexer->in_comment;
+
+      token = scan_token(lexer);
+      STATS_UNCOUNT(token, lexer->input, start, resumed);
+    } while (lexer->options.skip_comments && token.type == TOKEN_COMMENT);
+    lexer->diagnostics = diagnostics;
+  } else {
+    token = get_next_compact_token(lexer);
+  }
+  cursor->tokens[slot] = token;
+
+  cursor->tail++;
+  if (cursor->tail > cursor->lexed) {
+    cursor->lexed = cursor->tail;
+  }
+  if (cursor->tail - cursor->first > CURSOR_LOOKAHEAD) {
+    cursor->first++;
+  }
+}
+
+CompactToken cursor_peek(TokenCursor *cursor, size_t n) {
+  if (n >= CURSOR_LOOKAHEAD) {
+    n = CURSOR_LOOKAHEAD - 1;
+  }
+  while (cursor->tail <= cursor->head + n) {
+    lex_one(cursor);
+  }
+  return cursor->tokens[(cursor->head + n) % CURSOR_LOOKAHEAD];
+}
+
+CompactToken cursor_next(TokenCursor *cursor) {
+  CompactToken token = cursor_peek(cursor, 0);
+
+  cursor->head++;
+  return token;
+}
+
+CursorMark cursor_mark(const TokenCursor *cursor) {
+  CursorMark mark;
+
+  if (cursor->head < cursor->tail) {
+    return cursor->starts[cursor->head % CURSOR_LOOKAHEAD];
+  }
+  save_state(cursor, &mark);
+  return mark;
+}
+
+void cursor_reset(TokenCursor *cursor, const CursorMark *mark) {
+  Lexer *lexer = cursor->lexer;
+
+  if (mark->index >= cursor->first && mark->index <= cursor->tail) {
+    cursor->head = mark->index;
+    return;
+  }
+
+  // the token has left the ring, so lex again from just before it
+  lexer->pos = mark->pos;
+  lexer->line_start = mark->line_start;
+  lexer->line = mark->line;
+  lexer->in_comment = mark->in_comment;
+  lexer->last_token_type = mark->last_token_type;
+  cursor->head = mark->index;
+  cursor->first = mark->index;
+  cursor->tail = mark->index;
+}
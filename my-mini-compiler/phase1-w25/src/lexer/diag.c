@@ -0,0 +1,61 @@
+/* diag.c */
+#include "../../include/diag.h"
+#include <string.h>
+
+void diag_init(Diagnostics *diagnostics, Arena *arena, size_t max_errors) {
+  memset(diagnostics, 0, sizeof(*diagnostics));
+  diagnostics->arena = arena;
+  diagnostics->max_errors = max_errors;
+}
+
+/* Make room for one more diagnostic */
+static int reserve(Diagnostics *diagnostics) {
+  size_t capacity = diagnostics->capacity ? diagnostics->capacity * 2 : 64;
+  Diagnostic *items;
+
+  if (diagnostics->count < diagnostics->capacity) {
+    return 0;
+  }
+
+  items = arena_grow(diagnostics->arena, diagnostics->items, diagnostics->count * sizeof(Diagnostic),
+                     capacity * sizeof(Diagnostic));
+  if (items == NULL) {
+    return -1;
+  }
+  diagnostics->items = items;
+  diagnostics->capacity = capacity;
+  return 0;
+}
+
+int diag_add(Diagnostics *diagnostics, ErrorType code, Severity severity, size_t offset, size_t length, int line,
+             int column) {
+  if (reserve(diagnostics) == 0) {
+    Diagnostic *diagnostic = &diagnostics->items[diagnostics->count++];
+
+    diagnostic->code = code;
+    diagnostic->severity = severity;
+    diagnostic->offset = (uint32_t)offset;
+    diagnostic->length = (uint32_t)length;
+    diagnostic->line = line;
+    diagnostic->column = column;
+  } else {
+    diagnostics->failed = 1;
+  }
+
+  if (severity != SEVERITY_ERROR) {
+    return 0;
+  }
+  diagnostics->errors++;
+  return diagnostics->max_errors > 0 && diagnostics->errors >= diagnostics->max_errors;
+}
+
+const char *severity_name(Severity severity) {
+  switch (severity) {
+  case SEVERITY_ERROR:
+    return "error";
+  case SEVERITY_FATAL:
+    return "fatal";
+  default:
+    return "unknown";
+  }
+}
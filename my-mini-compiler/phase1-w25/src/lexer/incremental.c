@@ -0,0 +1,306 @@
+/* incremental.c */
+#include "../../include/incremental.h"
+#include <stdlib.h>
+#include <string.h>
+
+static size_t token_end(CompactToken token) {
+  return (size_t)token.offset + token.length;
+}
+
+/* Bytes of text after the edit point handed to the lexer at first; it gets
+ * more if a token runs into the text gap
+ */
+#define EDIT_WINDOW 256
+
+/* Make the text gap at least size bytes wide */
+static int reserve_text_gap(IncrementalLexer *document, size_t size) {
+  size_t tail = document->text_capacity - document->gap_end;
+  size_t capacity = document->text_capacity ? document->text_capacity : 64;
+  char *resized;
+
+  if (document->gap_end - document->gap_start >= size) {
+    return 0;
+  }
+  while (capacity - document->length < size) {
+    capacity *= 2;
+  }
+  resized = realloc(document->text, capacity);
+  if (resized == NULL) {
+    return -1;
+  }
+  memmove(resized + capacity - tail, resized + document->gap_end, tail);
+  document->text = resized;
+  document->text_capacity = capacity;
+  document->gap_end = capacity - tail;
+  return 0;
+}
+
+/* Move the text gap to start at offset */
+static void move_text_gap(IncrementalLexer *document, size_t offset) {
+  size_t size;
+
+  if (offset < document->gap_start) {
+    size = document->gap_start - offset;
+    memmove(document->text + document->gap_end - size, document->text + offset, size);
+    document->gap_start -= size;
+    document->gap_end -= size;
+  } else if (offset > document->gap_start) {
+    size = offset - document->gap_start;
+    memmove(document->text + document->gap_start, document->text + document->gap_end, size);
+    document->gap_start += size;
+    document->gap_end += size;
+  }
+}
+
+/* Move up to size more bytes from after the text gap to before it, and
+ * return how much text is contiguous now
+ */
+static size_t open_text(IncrementalLexer *document, size_t size) {
+  size_t offset = document->gap_start + size;
+
+  move_text_gap(document, offset < document->length ? offset : document->length);
+  return document->gap_start;
+}
+
+const char *incremental_text(IncrementalLexer *document) {
+  move_text_gap(document, document->length);
+  return document->text;
+}
+
+/* Make sure the gap has room for at least one token */
+static int widen_gap(IncrementalLexer *document) {
+  size_t capacity = document->capacity ? document->capacity * 2 : 256;
+  CompactToken *resized;
+
+  if (document->before + document->after < document->capacity) {
+    return 0;
+  }
+  resized = realloc(document->tokens, capacity * sizeof(CompactToken));
+  if (resized == NULL) {
+    return -1;
+  }
+  memmove(resized + capacity - document->after, resized + document->capacity - document->after,
+          document->after * sizeof(CompactToken));
+  document->tokens = resized;
+  document->capacity = capacity;
+  return 0;
+}
+
+/* Switch a token between real offset and line and counting back from the
+ * end of the document (the same sum works both ways)
+ */
+static CompactToken flip_end(const IncrementalLexer *document, CompactToken token) {
+  token.offset = (uint32_t)document->length - token.offset;
+  token.line = document->lines - token.line;
+  return token;
+}
+
+CompactToken incremental_token(const IncrementalLexer *document, size_t index) {
+  if (index < document->before) {
+    return document->tokens[index];
+  }
+  return flip_end(document, document->tokens[document->capacity - document->after + index - document->before]);
+}
+
+/* Move the gap so that before tokens come before it */
+static void move_gap(IncrementalLexer *document, size_t before) {
+  while (document->before < before) {
+    document->tokens[document->before++] =
+        flip_end(document, document->tokens[document->capacity - document->after]);
+    document->after--;
+  }
+  while (document->before > before) {
+    document->after++;
+    document->tokens[document->capacity - document->after] =
+        flip_end(document, document->tokens[--document->before]);
+  }
+}
+
+int incremental_init(IncrementalLexer *document, const char *text, size_t length) {
+  Lexer lexer;
+  CompactToken token;
+
+  memset(document, 0, sizeof(*document));
+  if (reserve_text_gap(document, length + EDIT_WINDOW) != 0) {
+    return -1;
+  }
+  memcpy(document->text, text, length);
+  document->length = length;
+  document->gap_start = length;
+
+  lexer_init(&lexer, document->text, length);
+  do {
+    token = scan_token(&lexer);
+    if (widen_gap(document) != 0) {
+      incremental_free(document);
+      return -1;
+    }
+    document->tokens[document->before++] = token;
+  } while (token.type != TOKEN_EOF);
+  document->count = document->before;
+  document->lines = token.line;
+  return 0;
+}
+
+/* Set lexer up to continue after the first count tokens, as if it had just
+ * returned them
+ */
+static void resume_after(Lexer *lexer, const CompactToken *tokens, size_t count) {
+  size_t pos = count > 0 ? token_end(tokens[count - 1]) : 0;
+  size_t from = 0;
+  size_t i;
+  char last = 'x';
+
+  lexer->pos = pos;
+  lexer->line = 1;
+
+  // a token's line is the line it starts on, so count the newlines since
+  // the start of the last one
+  if (count > 0) {
+    lexer->line = (int)tokens[count - 1].line;
+    from = tokens[count - 1].offset;
+  }
+  for (; from < pos; from++) {
+    if (lexer->input[from] == '\n') {
+      lexer->line++;
+    }
+  }
+
+  lexer->line_start = pos;
+  while (lexer->line_start > 0 && lexer->input[lexer->line_start - 1] != '\n') {
+    lexer->line_start--;
+  }
+
+  // invalid characters leave last_token_type alone, so look back past them
+  for (i = count; i > 0; i--) {
+    if (tokens[i - 1].type != TOKEN_ERROR || tokens[i - 1].error == ERROR_CONSECUTIVE_OPERATORS) {
+      last = last_type_after('x', tokens[i - 1]);
+      break;
+    }
+  }
+  lexer->last_token_type = last;
+}
+
+static int count_newlines(const char *text, size_t length) {
+  const char *end = text + length;
+  int count = 0;
+
+  while ((text = memchr(text, '\n', end - text)) != NULL) {
+    count++;
+    text++;
+  }
+  return count;
+}
+
+int incremental_edit(IncrementalLexer *document, size_t offset, size_t deleted, const char *inserted,
+                     size_t inserted_length, TokenChange *change) {
+  size_t old_length = document->length;
+  size_t window = EDIT_WINDOW;
+  size_t removed = 0;
+  size_t kept, lo, hi;
+  size_t old_start; // Old offset of the call that lexed the first token after the gap
+  char old_last;    // and last_token_type then
+  long shift;
+  Lexer lexer;
+  Lexer before;
+  CompactToken token;
+
+  if (offset > document->length || deleted > document->length - offset ||
+      reserve_text_gap(document, inserted_length) != 0) {
+    return -1;
+  }
+  shift = (long)inserted_length - (long)deleted;
+
+  // every token also looks at the byte just past its end, so only tokens
+  // ending before offset are certain to come out the same
+  lo = 0;
+  hi = document->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (token_end(incremental_token(document, mid)) < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  kept = lo;
+  move_gap(document, kept);
+
+  // the deleted bytes are dropped into the gap, the inserted ones added
+  // at its start
+  move_text_gap(document, offset);
+  document->lines += count_newlines(inserted, inserted_length) -
+                     count_newlines(document->text + document->gap_end, deleted);
+  document->gap_end += deleted;
+  memcpy(document->text + document->gap_start, inserted, inserted_length);
+  document->gap_start += inserted_length;
+  document->length += shift;
+
+  // the lexer sees the text up to the gap, which is moved out of its way
+  // when a token gets too close to it
+  lexer_init(&lexer, document->text, open_text(document, window));
+  resume_after(&lexer, document->tokens, kept);
+
+  // lex into the token gap until a call starts past the edit where,
+  // shifted, a call that lexed an old token started, in the same state;
+  // from there on the old tokens are right. Old tokens passed on the way
+  // are dropped.
+  old_start = lexer.pos;
+  old_last = lexer.last_token_type;
+  for (;;) {
+    if (lexer.pos >= offset + inserted_length) {
+      size_t at = lexer.pos - shift;
+
+      while (document->after > 0 && old_start < at) {
+        // still counted back from the old end
+        CompactToken old = document->tokens[document->capacity - document->after];
+
+        old.offset = (uint32_t)old_length - old.offset;
+        old_last = last_type_after(old_last, old);
+        old_start = token_end(old);
+        document->after--;
+        removed++;
+      }
+      if (document->after > 0 && old_start == at && old_last == lexer.last_token_type) {
+        break;
+      }
+    }
+
+    if (widen_gap(document) != 0) {
+      return -1;
+    }
+    before = lexer;
+    token = scan_token(&lexer);
+
+    // a token that reached the text gap (or the end the lexer can see) may
+    // go on past it, so open more text and lex it again
+    if (lexer.length < document->length && (token.type == TOKEN_EOF || token_end(token) >= lexer.length)) {
+      window *= 2;
+      lexer = before;
+      lexer.length = open_text(document, window);
+      continue;
+    }
+
+    document->tokens[document->before++] = token;
+    if (token.type == TOKEN_EOF) {
+      removed += document->after;
+      document->after = 0;
+      break;
+    }
+  }
+
+  if (change != NULL) {
+    change->first = kept;
+    change->removed = removed;
+    change->inserted = document->before - kept;
+  }
+  document->count = document->before + document->after;
+  return 0;
+}
+
+void incremental_free(IncrementalLexer *document) {
+  free(document->text);
+  free(document->tokens);
+  memset(document, 0, sizeof(*document));
+}
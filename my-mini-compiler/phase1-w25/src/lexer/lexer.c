@@ -1,403 +1,678 @@
 /* lexer.c */
-#include "../../include/tokens.h"
-#include <ctype.h>
+#include "../../include/lexer.h"
+#include "../../include/diag.h"
+#include "../../include/lineindex.h"
+#include "../../include/symtab.h"
+#include "charclass.h"
+#include "counters.h"
+#include "dfa_tables.h"
+#include "scan.h"
+#include "utf8.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Line tracking
-static int current_line = 1;
-static char last_token_type = 'x'; // For checking consecutive operators
+/* Set up a lexer at the start of input with default options */
+void lexer_init(Lexer *lexer, const char *input, size_t length) {
+  lexer->input = input;
+  lexer->length = length;
+  lexer->pos = 0;
+  lexer->line = 1;
+  lexer->line_start = 0;
+  lexer->last_token_type = 'x';
+  lexer->in_comment = 0;
+  lexer->scan = scan_ops_best();
+  lexer->symbols = NULL;
+  lexer->lines = NULL;
+  lexer->diagnostics = NULL;
+  lexer->utf8_from = 1;
+  lexer->utf8_error = 0;
+  lexer->options = lexer_default_options();
+}
 
-/* Print error messages for lexical errors */
-void print_error(ErrorType error, int line, const char *lexeme) {
-  printf("Lexical Error at line %d: ", line);
+LexerOptions lexer_default_options(void) {
+  LexerOptions options;
+
+  options.skip_comments = 0;
+  options.utf8 = 0;
+  options.identifiers = IDENTIFIERS_C11;
+  lexer_set_limits(&options, LEXEME_LIMIT_DEFAULT);
+  return options;
+}
+
+/* Set every length limit to limit */
+void lexer_set_limits(LexerOptions *options, size_t limit) {
+  options->max_identifier = limit;
+  options->max_string = limit;
+  options->max_number = limit;
+  options->max_line_comment = limit;
+}
+
+/* End of a token starting at pos that may be at most limit bytes long */
+static inline size_t limit_end(const Lexer *lexer, size_t pos, size_t limit) {
+  if (limit == 0 || limit > lexer->length - pos) {
+    return lexer->length;
+  }
+  return pos + limit;
+}
+
+/* In UTF-8 mode, move the end a length limit gives a token starting at pos
+ * back out of a character it would cut in two, keeping at least one byte
+ */
+static inline size_t whole_characters(const Lexer *lexer, size_t pos, size_t end) {
+  if (!lexer->options.utf8 || end >= lexer->length) {
+    return end;
+  }
+  return end - utf8_cut_tail(lexer->input, pos + 1, end);
+}
+
+/* Column (1-based) of the next character to read */
+int lexer_column(const Lexer *lexer) {
+  return (int)(lexer->pos - lexer->line_start) + 1;
+}
+
+/* SourceLocation of offset, see lexer.h */
+SourceLocation lexer_locate(const Lexer *lexer, size_t offset) {
+  SourceLocation location = {lexer->line, 0};
+  size_t start = offset;
+  size_t i;
+
+  if (lexer->lines != NULL) {
+    return line_index_locate(lexer->lines, offset);
+  }
+  if (offset >= lexer->line_start) {
+    location.column = (int)(offset - lexer->line_start) + 1;
+    return location;
+  }
+
+  // an earlier line: count back to it and find where it starts
+  for (i = offset; i < lexer->line_start; i++) {
+    if (lexer->input[i] == '\n') {
+      location.line--;
+    }
+  }
+  while (start > 0 && lexer->input[start - 1] != '\n') {
+    start--;
+  }
+  location.column = (int)(offset - start) + 1;
+  return location;
+}
+
+/* Where a scan should count the newlines it passes: nowhere if the lines
+ * can be looked up instead
+ */
+static inline NewlineCount *line_counter(const Lexer *lexer, NewlineCount *lines) {
+  return lexer->lines != NULL ? NULL : lines;
+}
+
+/* Bring line and line_start up to pos after a scan, from the line index or
+ * the newlines the scan counted
+ * Tokens move forward, so the index is walked rather than searched, one
+ * step per line passed.
+ */
+static inline void add_lines(Lexer *lexer, const NewlineCount *lines) {
+  const LineIndex *index = lexer->lines;
+
+  if (index != NULL) {
+    while ((size_t)lexer->line <= index->count && index->starts[lexer->line - 1] <= lexer->pos) {
+      lexer->line_start = index->starts[lexer->line - 1];
+      lexer->line++;
+    }
+  } else if (lines->count > 0) {
+    lexer->line += (int)lines->count;
+    lexer->line_start = lines->last + 1;
+  }
+}
+
+/* Scan a block comment body up to and including its closing delimiter
+ * Returns 1 if the comment was closed, 0 if it ran to the end of input
+ */
+static int scan_block_comment(Lexer *lexer) {
+  NewlineCount lines = {0, 0};
+  size_t end = lexer->scan->find_comment_end(lexer->input, lexer->pos, lexer->length, line_counter(lexer, &lines));
+  int closed = end < lexer->length;
+
+  lexer->pos = closed ? end + 2 : lexer->length;
+  add_lines(lexer, &lines);
+  return closed;
+}
+
+#define STRINGIFY(x) #x
+#define NUMBER_TEXT(x) STRINGIFY(x)
+
+const char *error_message(ErrorType error) {
   switch (error) {
   case ERROR_INVALID_CHAR:
-    printf("Invalid character '%s'\n", lexeme);
-    break;
+    return "Invalid character";
   case ERROR_INVALID_NUMBER_FORMAT:
-    printf("Invalid number format\n");
-    break;
+    return "Invalid number format";
   case ERROR_INVALID_NUMBER_VALUE:
-    printf("Invalid number value (needs to be within %d to %d)\n", MIN_NUMBER_SIZE, MAX_NUMBER_SIZE);
-    break;
+    return "Invalid number value (needs to be within " NUMBER_TEXT(MIN_NUMBER_SIZE) " to " NUMBER_TEXT(
+        MAX_NUMBER_SIZE) ")";
   case ERROR_CONSECUTIVE_OPERATORS:
-    printf("Consecutive operators not allowed\n");
-    break;
+    return "Consecutive operators not allowed";
   case ERROR_UNTERMINATED_STRING:
-    printf("Unterminated string literal\n");
-    break;
+    return "Unterminated string literal";
   case ERROR_IDENTIFIER_TOO_LONG:
-    printf("Identifier name too long\n");
-    break;
+    return "Identifier name too long";
+  case ERROR_INVALID_UTF8:
+    return "Invalid UTF-8";
+  case ERROR_TOO_MANY_ERRORS:
+    return "Too many errors, lexing stopped";
   default:
-    printf("Unknown error\n");
+    return "Unknown error";
   }
 }
 
-/* Print token information
- *
- *  TODO Update your printing function accordingly
- */
-
-void print_token(Token token) {
-  if (token.error != ERROR_NONE) {
-    print_error(token.error, token.line, token.lexeme);
-    return;
-  }
-
-  printf("Token: ");
-  switch (token.type) {
+const char *token_type_name(TokenType type) {
+  switch (type) {
   case TOKEN_NUMBER:
-    printf("NUMBER");
-    break;
+    return "NUMBER";
   case TOKEN_OPERATOR:
-    printf("OPERATOR");
-    break;
+    return "OPERATOR";
   case TOKEN_EOF:
-    printf("EOF");
-    break;
+    return "EOF";
   case TOKEN_KEYWORD:
-    printf("KEYWORD");
-    break;
+    return "KEYWORD";
   case TOKEN_IDENTIFIER:
-    printf("IDENTIFIER");
-    break;
+    return "IDENTIFIER";
   case TOKEN_STRING:
-    printf("STRING");
-    break;
+    return "STRING";
   case TOKEN_DELIMITER:
-    printf("DELIMITER");
-    break;
+    return "DELIMITER";
   case TOKEN_COMMENT:
-    printf("COMMENT");
-    break;
+    return "COMMENT";
   default:
-    printf("UNKNOWN");
+    return "UNKNOWN";
   }
-  printf(" | Lexeme: '%s' | Line: %d\n", token.lexeme, token.line);
 }
 
-/* Get next token from input */
-Token get_next_token(const char *input, int *pos) {
-  Token token = {TOKEN_ERROR, "", current_line, ERROR_NONE};
-  char c;
-
-  // Skip whitespace and track line numbers
-  while (((c = input[*pos]) != '\0') && (c == ' ' || c == '\n' || c == '\t')) {
-    if (c == '\n') {
-      current_line++;
-    }
-    (*pos)++;
+/* Print error messages for lexical errors */
+void print_error(ErrorType error, int line, const char *lexeme) {
+  printf("Lexical Error at line %d: %s", line, error_message(error));
+  if (error == ERROR_INVALID_CHAR) {
+    printf(" '%s'", lexeme);
   }
+  printf("\n");
+}
+/* Print token information
+ *
+ *  TODO Update your printing function accordingly
+ */
 
-  // create end of file token
-  if (input[*pos] == '\0') {
-    token.type = TOKEN_EOF;
-    strcpy(token.lexeme, "EOF");
-    token.line = current_line;
-    return token;
+void print_token(Token token) {
+  if (token.error != ERROR_NONE) {
+    print_error(token.error, token.line, token.lexeme);
+    return;
   }
 
-  c = input[*pos];
+  // all of the lexeme, which may be longer than the inline copy; a NUL
+  // byte still ends it
+  printf("Token: %s | Lexeme: '%.*s' | Line: %d\n", token_type_name(token.type), (int)token.length, token.text,
+         token.line);
+}
 
-  // TODO: Add comment handling here
-  // Single-Line Comments
-  if (c == '/' &&
-      input[*pos + 1] == '/') // check if the first 2 characters are //
-  {
-    int i = 0;
-    do {
-      token.lexeme[i++] = c;
-      (*pos)++;
-      c = input[*pos];
-    } while (c != '\n' && i < sizeof(token.lexeme) - 1);
+/* Keyword spellings, indexed by KeywordId */
+static const char *const keyword_text[KEYWORD_COUNT] = {
+    [KEYWORD_NONE] = "",
+#define KEYWORD(id, text) [KEYWORD_##id] = text,
+#include "../../include/keywords.def"
+#undef KEYWORD
+};
+
+/* Spelling of a keyword */
+const char *keyword_name(KeywordId keyword) {
+  return keyword < KEYWORD_COUNT ? keyword_text[keyword] : "";
+}
 
-    token.lexeme[i] = '\0';
-    token.type = TOKEN_COMMENT;
-    last_token_type = 'c';
-    token.line = current_line;
-    return token;
+/* Value of a number lexeme, clamped so huge literals can't overflow */
+static long number_value(const char *lexeme, size_t length) {
+  long value = 0;
+  int negative = 0;
+  size_t i = 0;
+
+  if (length > 0 && lexeme[0] == '-') {
+    negative = 1;
+    i = 1;
   }
 
-  // Multi-Line Comments
-  if (c == '/' && input[*pos + 1] == '*') {
-    int i = 0;
+  for (; i < length && (CHAR_CLASS(lexeme[i]) & CC_DIGIT); i++) {
+    if (value <= MAX_NUMBER_SIZE) {
+      value = value * 10 + (lexeme[i] - '0');
+    }
+  }
 
-    token.lexeme[i++] = c;
-    (*pos)++;
-    c = input[*pos];
-    token.lexeme[i++] = c;
-    (*pos)++;
+  return negative ? -value : value;
+}
 
-    if (c == '\n') {
-      current_line++;
+/* Longest match of the token DFA from pos, reading no further than end
+ * Returns where the match ends and sets action to its rule, or to DFA_NONE
+ * (with pos returned) if nothing matches.
+ */
+static inline size_t dfa_match(const char *input, size_t pos, size_t end, int *action) {
+  size_t match = pos;
+  int accepted = DFA_NONE;
+  unsigned int state = DFA_START;
+
+  while (pos < end) {
+    state = dfa_next[state + dfa_class[(unsigned char)input[pos]]];
+    if (state == DFA_DEAD) {
+      break;
+    }
+    pos++;
+    if (dfa_next[state] != DFA_NONE) {
+      accepted = dfa_next[state];
+      match = pos;
     }
+  }
 
-    do {
-      c = input[*pos];
-      if (c == '\n') {
-        current_line++;
-      }
+  *action = accepted;
+  return match;
+}
 
-      if (i < sizeof(token.lexeme) - 1) {
-        token.lexeme[i++] = c;
-      }
+/* Is input from start to end well-formed UTF-8? start must be where a
+ * character starts
+ * The input is checked ahead of the lexer, up to the next malformed
+ * sequence or the end, so the strings and comments before that cost a
+ * comparison each; on ASCII input that's the whole input in one pass.
+ */
+static inline int utf8_valid(Lexer *lexer, size_t start, size_t end) {
+  if (start < lexer->utf8_from || start > lexer->utf8_error) {
+    lexer->utf8_from = start;
+    lexer->utf8_error = lexer->scan->find_invalid_utf8(lexer->input, start, lexer->length);
+  }
+  return end <= lexer->utf8_error;
+}
 
-      (*pos)++;
+/* In UTF-8 mode, flag a token whose text from start to end isn't UTF-8 */
+static inline void check_utf8(Lexer *lexer, CompactToken *token, size_t start, size_t end) {
+  if (lexer->options.utf8 && token->error == ERROR_NONE && !utf8_valid(lexer, start, end)) {
+    token->error = ERROR_INVALID_UTF8;
+  }
+}
 
-    } while (!((c == '*' && input[*pos] == '/')) && *pos < strlen(input) - 1);
+/* Length of the character at pos if it's past ASCII and the identifier
+ * policy allows it in an identifier (first: at the start of one), else 0
+ */
+static size_t identifier_char(const Lexer *lexer, size_t pos, int first) {
+  uint32_t code_point;
+  size_t length;
 
-    if (i < sizeof(token.lexeme) - 1) {
-      token.lexeme[i++] = input[*pos];
-    }
-    (*pos)++;
+  if ((unsigned char)lexer->input[pos] < 0x80) {
+    return 0;
+  }
+  length = utf8_decode(lexer->input, pos, lexer->length, &code_point);
+  switch (lexer->options.identifiers) {
+  case IDENTIFIERS_C11:
+    return length > 0 && c11_identifier_char(code_point, first) ? length : 0;
+  case IDENTIFIERS_ANY:
+    return length;
+  default:
+    return 0;
+  }
+}
 
-    if (i < sizeof(token.lexeme) - 1) {
-      token.lexeme[i++] = input[*pos];
-    }
-    (*pos)++;
+/* End of the identifier characters from pos on, ASCII or not */
+static size_t identifier_end(const Lexer *lexer, size_t pos) {
+  size_t length;
 
-    token.lexeme[i] = '\0';
+  while (pos < lexer->length) {
+    if (CHAR_CLASS(lexer->input[pos]) & CC_IDENT_CONT) {
+      pos++;
+    } else if ((length = identifier_char(lexer, pos, 0)) > 0) {
+      pos += length;
+    } else {
+      break;
+    }
+  }
+  return pos;
+}
 
-    token.type = TOKEN_COMMENT;
-    last_token_type = 'c';
-    token.line = current_line;
+/* Is byte c whitespace or the first byte of a token? That's the start
+ * class of tokens.spec, read off the DFA: its INVALID rule takes the rest
+ */
+static inline int starts_token(unsigned char c) {
+  return dfa_next[dfa_next[DFA_START + dfa_class[c]]] != DFA_INVALID;
+}
 
-    return token;
+/* In UTF-8 mode, where the token DFA found invalid characters at pos: the
+ * end of an identifier if one starts there (setting action), else of the
+ * run of invalid characters before the next token or identifier
+ */
+static size_t scan_invalid_utf8(const Lexer *lexer, size_t pos, int *action) {
+  const char *input = lexer->input;
+  size_t length = identifier_char(lexer, pos, 1);
+  uint32_t code_point;
+
+  if (length > 0) {
+    *action = DFA_IDENTIFIER;
+    return identifier_end(lexer, pos + length);
   }
 
-  // Handle numbers
-  if (isdigit(c) || c == '-') {
-    int i = 0;
-    int isOperator = 0;
+  while (pos < lexer->length) {
+    unsigned char c = (unsigned char)input[pos];
 
-    //check if number hyphen is an operator or part of a number
-    if (c == '-') {
-      token.lexeme[i + 1] = c;
-      if (!isdigit(input[(*pos) + 1])) isOperator = 1;
+    if (starts_token(c) || identifier_char(lexer, pos, 1) > 0) {
+      break;
     }
+    if (c < 0x80) {
+      pos++;
+    } else {
+      length = utf8_decode(input, pos, lexer->length, &code_point);
+      pos += length > 0 ? length : 1;
+    }
+  }
+  return pos;
+}
 
-    if (!isOperator) {
-      do {
-        token.lexeme[i++] = c;
-        (*pos)++;
-        c = input[*pos];
-        
-        //check for invalid character in number
-        if (!isdigit(c) && c != '\n' && c != ';' && c != '\t'  && c != ' ' && c != '\0' && c != '+' && c != '-' && c != '*' && c != '/' && c != '&' && c != '|' && c != '%' && c != '=' && c != ')' && c != '(' && c != '}' && c != '{') token.error = ERROR_INVALID_NUMBER_FORMAT;
-
-      } while (((token.error == ERROR_NONE && isdigit(c)) || (token.error == ERROR_INVALID_NUMBER_FORMAT && c != '\n' && c != ';' && c != '\t' && c != ' ' && c != '+' && c != '-' && c != '*' && c != '/' && c != '&' && c != '|' && c != '%' && c != '=' && c != ')' && c != '(' && c != '}' && c != '{')) && i < sizeof(token.lexeme) - 1);
+/* Scan one token, comments included
+ * The DFA generated from tokens.spec finds the longest token at the current
+ * position, or how a comment or string opens; what follows scans those to
+ * their end, applies the length limits in the lexer's options and sets each
+ * kind of token's errors. The token only records where its lexeme
+ * sits in the input, so its length is only bounded by those limits.
+ */
+static inline CompactToken scan_body(Lexer *lexer) {
+  const char *input = lexer->input;
+  CompactToken token = {0, 0, lexer->line, TOKEN_ERROR, ERROR_NONE, 0};
+  NewlineCount lines = {0, 0};
+  size_t limit;
+  size_t max;
+  size_t length;
+  int action;
+
+  // Finish a block comment that was cut off at the end of the previous input
+  if (lexer->in_comment) {
+    token.offset = (uint32_t)lexer->pos;
+    lexer->in_comment = !scan_block_comment(lexer);
+    token.length = (uint32_t)(lexer->pos - token.offset);
+    token.type = TOKEN_COMMENT;
+    check_utf8(lexer, &token, token.offset, lexer->pos);
+    lexer->last_token_type = 'c';
+    return token;
+  }
 
-      token.lexeme[i] = '\0';
+  // Skip whitespace (\r included, for Windows line endings) and track line numbers
+  lexer->pos = lexer->scan->skip_whitespace(input, lexer->pos, lexer->length, line_counter(lexer, &lines));
+  add_lines(lexer, &lines);
+  STATS_MARK();
 
-      if (token.error == ERROR_NONE) {
-        int number = atoi(token.lexeme);
+  // every token is on the line it starts on
+  token.offset = (uint32_t)lexer->pos;
+  token.line = lexer->line;
 
-        if (number < MIN_NUMBER_SIZE || number > MAX_NUMBER_SIZE) {
-          token.error = ERROR_INVALID_NUMBER_VALUE;
-        }
+  // create end of file token
+  if (lexer->pos >= lexer->length) {
+    token.type = TOKEN_EOF;
+    return token;
+  }
 
-      }
-      
-      token.type = TOKEN_NUMBER;
-      last_token_type = 'n';
-      token.line = current_line;
-      return token;
-    }
+  length = dfa_match(input, lexer->pos, lexer->length, &action) - lexer->pos;
+  if (action == DFA_INVALID && lexer->options.utf8) {
+    length = scan_invalid_utf8(lexer, lexer->pos, &action) - lexer->pos;
   }
 
-  // TODO: Add keyword and identifier handling here
-  // check if starts with a letter or underscore
-  if (isalpha(c) || c == '_') {
-    int i = 0;
-    do {
-      token.lexeme[i++] = c;
-      (*pos)++;
-      c = input[*pos];
-    } while ((isalnum(c) || c == '_') && i < sizeof(token.lexeme) - 1); // keep going as long as we're still
-                                            // finding letters or underscores
+  switch (action) {
+  case DFA_LINE_COMMENT:
+    // runs to the end of the line, or the length limit
+    limit = whole_characters(lexer, lexer->pos, limit_end(lexer, lexer->pos, lexer->options.max_line_comment));
+    length = lexer->scan->find_line_end(input, lexer->pos + 1, limit) - lexer->pos;
+    token.type = TOKEN_COMMENT;
+    lexer->last_token_type = 'c';
+    check_utf8(lexer, &token, lexer->pos, lexer->pos + length);
+    break;
 
-    if (i == sizeof(token.lexeme) - 1) {
-      token.error = ERROR_IDENTIFIER_TOO_LONG;
-    }
+  case DFA_BLOCK_COMMENT:
+    // an unterminated comment runs to the end of input
+    lexer->pos += 2;
+    scan_block_comment(lexer);
+    token.length = (uint32_t)(lexer->pos - token.offset);
+    token.type = TOKEN_COMMENT;
+    lexer->last_token_type = 'c';
+    check_utf8(lexer, &token, token.offset, lexer->pos);
+    return token;
 
-    token.lexeme[i] = '\0';
-
-    // identify token as keyword or identifier
-    if (strcmp(token.lexeme, "if") == 0 ||
-        strcmp(token.lexeme, "repeat") == 0 ||
-        strcmp(token.lexeme, "until") == 0 ||
-        strcmp(token.lexeme, "else") == 0 ||
-        strcmp(token.lexeme, "while") == 0 ||
-        strcmp(token.lexeme, "for") == 0 || 
-        strcmp(token.lexeme, "do") == 0 ||
-        strcmp(token.lexeme, "return") == 0 ||
-        strcmp(token.lexeme, "int") == 0) {
-      token.type = TOKEN_KEYWORD;
-      last_token_type = 'k';
-    } else {
-      token.type = TOKEN_IDENTIFIER;
-      last_token_type = 'i';
+  case DFA_NUMBER:
+  case DFA_BAD_NUMBER:
+    // a number cut by the limit is still checked for a bad character up to
+    // and including the first one past the cut
+    max = lexer->options.max_number;
+    if (max > 0 && length > max) {
+      dfa_match(input, lexer->pos, limit_end(lexer, lexer->pos, max + 1), &action);
+      length = whole_characters(lexer, lexer->pos, lexer->pos + max) - lexer->pos;
     }
+    if (action == DFA_BAD_NUMBER) {
+      token.error = ERROR_INVALID_NUMBER_FORMAT;
+    } else {
+      long number = number_value(input + lexer->pos, length);
 
-    token.line = current_line;
-    return token;
-  }
-
-  // TODO: Add string literal handling here
-  if (c == '\"') {
-    int i = 0;
-
-    do {
-      token.lexeme[i++] = c;
-      (*pos)++;
-      c = input[*pos];
-      
-      //adjust for extra quotation, max string length is 98 + 2 quotations
-      if (i > sizeof(token.lexeme) - 2 || c == '\0' || c == '\n') {
-        token.error = ERROR_UNTERMINATED_STRING;
-        *(pos)--;
-        break;
+      if (number < MIN_NUMBER_SIZE || number > MAX_NUMBER_SIZE) {
+        token.error = ERROR_INVALID_NUMBER_VALUE;
       }
-    } while (c != '\"');
+    }
+    token.type = TOKEN_NUMBER;
+    lexer->last_token_type = 'n';
+    break;
 
-    if (c == '\"') {
-      token.lexeme[i++] = c;
+  case DFA_STRING:
+    // the closing quote has to come before the length limit
+    limit = whole_characters(lexer, lexer->pos, limit_end(lexer, lexer->pos, lexer->options.max_string));
+    length = lexer->scan->find_string_end(input, lexer->pos + 1, limit) - lexer->pos;
+
+    // without its closing quote the string stops before the end of the line
+    if (lexer->pos + length < limit && input[lexer->pos + length] == '\"') {
+      length++;
+    } else {
+      token.error = ERROR_UNTERMINATED_STRING;
     }
-    
-    (*pos)++;
-    c = input[*pos];
-    token.lexeme[i] = '\0';
+    check_utf8(lexer, &token, lexer->pos, lexer->pos + length);
     token.type = TOKEN_STRING;
-    last_token_type = 's';
-    token.line = current_line;
-    return token;
-  }
+    lexer->last_token_type = 's';
+    if (lexer->symbols) {
+      token.id = symtab_intern(lexer->symbols, input + lexer->pos, length);
+    }
+    break;
 
-  // Handle operators
-  if (c == '+' || c == '-' || c == '*' || c == '/' || c == '&' || c == '|' ||
-      c == '%' || c == '=' || c == '!') {
-    if (last_token_type == 'o') {
+  case DFA_OPERATOR:
+    if (lexer->last_token_type == 'o') {
       // Check for consecutive operators
       token.error = ERROR_CONSECUTIVE_OPERATORS;
-      token.lexeme[0] = c;
-      token.lexeme[1] = '\0';
-      (*pos)++;
-      token.line = current_line;
-      return token;
+      break;
     }
     token.type = TOKEN_OPERATOR;
-    token.lexeme[0] = c;
-    token.lexeme[1] = '\0';
-    last_token_type = 'o';
-    (*pos)++;
-    token.line = current_line;
-    return token;
-  }
+    lexer->last_token_type = 'o';
+    break;
 
-  // TODO: Add delimiter handling here
-  if (c == '{' || c == '}' || c == '[' || c == ']' || c == ',' || c == '(' ||
-      c == ')' || c == ';') {
-    token.lexeme[0] = c;
-    (*pos)++;
-    c = input[*pos];
+  case DFA_DELIMITER:
+    lexer->pos += length;
+    token.length = (uint32_t)length;
     token.type = TOKEN_DELIMITER;
-    last_token_type = 'd';
+    lexer->last_token_type = 'd';
     return token;
+
+  case DFA_NONE:
+    length = 1;
+    // fall through
+  case DFA_INVALID:
+    // a run of characters that can't start a token is one error
+    token.error = ERROR_INVALID_CHAR;
+    break;
+
+  case DFA_IDENTIFIER:
+  default:
+    // identifiers and keywords; in UTF-8 mode they may go on past ASCII,
+    // and are then never keywords
+    if (lexer->options.utf8 && lexer->pos + length < lexer->length &&
+        (unsigned char)input[lexer->pos + length] >= 0x80) {
+      size_t end = identifier_end(lexer, lexer->pos + length);
+
+      if (end > lexer->pos + length) {
+        length = end - lexer->pos;
+        action = DFA_IDENTIFIER;
+      }
+    }
+
+    // one as long as the limit is an error, and is a keyword if what's left
+    // of it spells one
+    max = lexer->options.max_identifier;
+    if (max > 0 && length >= max) {
+      length = whole_characters(lexer, lexer->pos, lexer->pos + max) - lexer->pos;
+      if (dfa_match(input, lexer->pos, lexer->pos + length, &action) != lexer->pos + length) {
+        action = DFA_IDENTIFIER;
+      }
+      token.error = ERROR_IDENTIFIER_TOO_LONG;
+    }
+    token.id = dfa_keyword[action];
+    if (token.id != KEYWORD_NONE) {
+      token.type = TOKEN_KEYWORD;
+      lexer->last_token_type = 'k';
+    } else {
+      token.type = TOKEN_IDENTIFIER;
+      lexer->last_token_type = 'i';
+      if (lexer->symbols) {
+        token.id = symtab_intern(lexer->symbols, input + lexer->pos, length);
+      }
+    }
+    break;
   }
 
-  // Handle invalid characters
-  token.error = ERROR_INVALID_CHAR;
-  token.lexeme[0] = c;
-  token.lexeme[1] = '\0';
-  (*pos)++;
-  token.line = current_line;
+  lexer->pos += length;
+  token.length = (uint32_t)length;
   return token;
 }
 
-void print_raw(const char *buffer) {
-  while (*buffer) {
-    switch (*buffer) {
-    case '\n':
-      printf("\\n");
-      break;
-    case '\t':
-      printf("\\t");
-      break;
-    case '\r':
-      printf("\\r");
-      break;
-    case '\0':
-      printf("\\0");
-      break;
-    default:
-      putchar(*buffer);
-    }
-    buffer++;
+/* Add an error token to the lexer's diagnostics, cutting the input short
+ * if that reaches the error limit
+ */
+static void report_error(Lexer *lexer, CompactToken token) {
+  Diagnostics *diagnostics = lexer->diagnostics;
+  SourceLocation start = lexer_locate(lexer, token.offset);
+
+  if (diag_add(diagnostics, (ErrorType)token.error, SEVERITY_ERROR, token.offset, token.length, start.line,
+               start.column)) {
+    diag_add(diagnostics, ERROR_TOO_MANY_ERRORS, SEVERITY_FATAL, lexer->pos, 0, lexer->line, lexer_column(lexer));
+    diagnostics->stopped = 1;
+    lexer->length = lexer->pos;
   }
-  printf("\n\n");
 }
 
-// This is a basic lexer that handles numbers (e.g., "123", "456"), basic
-// operators (+ and -), consecutive operator errors, whitespace and newlines,
-// with simple line tracking for error reporting.
+/* Scan one token, counted against its recognizer in LEXER_STATS builds */
+static inline CompactToken scan_one(Lexer *lexer) {
+  CompactToken token;
+#ifdef LEXER_STATS
+  size_t start = lexer->pos;
+  int resumed = lexer->in_comment;
+  uint64_t begin = stats_clock();
+
+  counters.mark = begin;
+  token = scan_body(lexer);
+  count_token(token, lexer->input, start, resumed, begin, stats_clock());
+#else
+  token = scan_body(lexer);
+#endif
+  if (token.error != ERROR_NONE && lexer->diagnostics != NULL) {
+    report_error(lexer, token);
+  }
+  return token;
+}
 
-int main() {
-  // const char *input = "123 + 456 - 789\n1 ++ 2"; // Test with multi-line
-  // input
+/* last_token_type after token, given its value before */
+char last_type_after(char last, CompactToken token) {
+  switch (token.type) {
+  case TOKEN_COMMENT:
+    return 'c';
+  case TOKEN_NUMBER:
+    return 'n';
+  case TOKEN_KEYWORD:
+    return 'k';
+  case TOKEN_IDENTIFIER:
+    return 'i';
+  case TOKEN_STRING:
+    return 's';
+  case TOKEN_OPERATOR:
+    return 'o';
+  case TOKEN_DELIMITER:
+    return 'd';
+  default:
+    // a second operator in a row keeps 'o', an invalid character changes nothing
+    return token.error == ERROR_CONSECUTIVE_OPERATORS ? 'o' : last;
+  }
+}
+
+CompactToken scan_token(Lexer *lexer) {
+  return scan_one(lexer);
+}
 
-  // Test comments, keywords, identifiers
-  // const char *input =
-  //"// This is a comment \n /* Multi-line \n comment */ int x";
+/* Get next token from input without copying its lexeme */
+CompactToken get_next_compact_token(Lexer *lexer) {
+  CompactToken token;
 
-  FILE *file = fopen("../../test/input_invalid.txt", "r");
-  if (file == NULL) {
-    printf("Error opening file\n");
-    return 1;
-  }
+  do {
+    token = scan_one(lexer);
+  } while (lexer->options.skip_comments && token.type == TOKEN_COMMENT);
+
+  return token;
+}
+
+/* Fill tokens with up to capacity tokens, stopping after the EOF token */
+size_t lex_batch(Lexer *lexer, CompactToken *tokens, size_t capacity) {
+  size_t count = 0;
+  CompactToken token;
 
-  // get file size
-  fseek(file, 0, SEEK_END);
-  long file_size = ftell(file);
-  rewind(file);
+  while (count < capacity) {
+    token = scan_one(lexer);
+    if (lexer->options.skip_comments && token.type == TOKEN_COMMENT) {
+      continue;
+    }
 
-  // get buffer sizes
-  char *buffer = malloc(file_size + 1);
-  if (!buffer) {
-    printf("Memory allocation failed.\n");
-    fclose(file);
-    return 1;
+    tokens[count++] = token;
+    if (token.type == TOKEN_EOF) {
+      break;
+    }
   }
 
-  size_t bytes_read = fread(buffer, 1, file_size, file);
-  buffer[bytes_read] = '\0';
+  return count;
+}
 
-  //drop and ignore carriage return (on windows)
-  size_t j = 0;
-  for (size_t i = 0; i < bytes_read; i++) {
-      if (buffer[i] != '\r') {
-          buffer[j++] = buffer[i];
-      }
+/* Build a Token from a compact token and its lexeme text */
+Token token_from_text(CompactToken compact, const char *text, size_t text_length) {
+  Token token = {(TokenType)compact.type, "", (int)compact.line, 0, compact.offset, 0, 0,
+                 (ErrorType)compact.error, KEYWORD_NONE, 0, text, (uint32_t)text_length};
+  size_t length = text_length;
+
+  if (compact.type == TOKEN_KEYWORD) {
+    token.keyword = (KeywordId)compact.id;
+  } else {
+    token.symbol = compact.id;
   }
-  buffer[j] = '\0';
 
-  print_raw(buffer);
-  
-  int position = 0;
-  Token token;
+  if (compact.type == TOKEN_EOF) {
+    strcpy(token.lexeme, "EOF");
+    token.text = token_type_name(TOKEN_EOF);
+    token.length = 3;
+    return token;
+  }
 
-  printf("Analyzing input:\n%s\n\n", buffer);
+  if (length > MAX_LEXEME_SIZE - 1) {
+    length = MAX_LEXEME_SIZE - 1;
+  }
+  memcpy(token.lexeme, text, length);
+  token.lexeme[length] = '\0';
+  return token;
+}
 
-  int i = 0;
+/* Expand a compact token into a Token with its own copy of the lexeme */
+Token expand_token(const Lexer *lexer, CompactToken compact) {
+  Token token = token_from_text(compact, lexer->input + compact.offset, compact.length);
+  SourceLocation end = lexer_locate(lexer, (size_t)compact.offset + compact.length);
 
-  do {
-    token = get_next_token(buffer, &position);
-    print_token(token);
-    //printf("%d\n", i++);
-  } while (token.type != TOKEN_EOF);
-
-fclose(file);
-  return 0;
-} 
\ No newline at end of file
+  token.column = lexer_locate(lexer, compact.offset).column;
+  token.end_line = end.line;
+  token.end_column = end.column;
+  return token;
+}
+
+/* Get next token from input */
+Token get_next_token(Lexer *lexer) {
+  return expand_token(lexer, get_next_compact_token(lexer));
+}
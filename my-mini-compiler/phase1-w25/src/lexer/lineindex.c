@@ -0,0 +1,82 @@
+/* lineindex.c */
+#include "../../include/lineindex.h"
+#include "scan.h"
+#include <string.h>
+
+/* Bytes looked at per call when building, so the room the newlines in
+ * them might need stays small next to the index
+ */
+#define BUILD_CHUNK (64 * 1024)
+
+void line_index_init(LineIndex *index, Arena *arena) {
+  memset(index, 0, sizeof(*index));
+  index->arena = arena;
+}
+
+/* Make room for at least extra more starts */
+static int reserve(LineIndex *index, size_t extra) {
+  size_t capacity = index->capacity ? index->capacity : 1024;
+  uint32_t *starts;
+
+  if (index->count + extra <= index->capacity) {
+    return 0;
+  }
+
+  while (capacity < index->count + extra) {
+    capacity *= 2;
+  }
+  starts = arena_grow(index->arena, index->starts, index->count * sizeof(uint32_t), capacity * sizeof(uint32_t));
+  if (starts == NULL) {
+    return -1;
+  }
+  index->starts = starts;
+  index->capacity = capacity;
+  return 0;
+}
+
+int line_index_build(LineIndex *index, const char *input, size_t length) {
+  const ScanOps *scan = scan_ops_best();
+  size_t pos;
+
+  index->count = 0;
+  for (pos = 0; pos < length; pos += BUILD_CHUNK) {
+    size_t end = length - pos > BUILD_CHUNK ? pos + BUILD_CHUNK : length;
+
+    if (reserve(index, end - pos) != 0) {
+      return -1;
+    }
+    index->count += scan->find_newlines(input, pos, end, index->starts + index->count);
+  }
+  return 0;
+}
+
+size_t line_index_start(const LineIndex *index, int line) {
+  if (line == 1) {
+    return 0;
+  }
+  if (line < 2 || (size_t)line - 2 >= index->count) {
+    return LINE_INDEX_NONE;
+  }
+  return index->starts[line - 2];
+}
+
+SourceLocation line_index_locate(const LineIndex *index, size_t offset) {
+  SourceLocation location;
+  size_t low = 0;
+  size_t high = index->count;
+
+  // count the starts at or before offset
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+
+    if (index->starts[middle] <= offset) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  location.line = (int)low + 1;
+  location.column = (int)(offset - (low > 0 ? index->starts[low - 1] : 0)) + 1;
+  return location;
+}
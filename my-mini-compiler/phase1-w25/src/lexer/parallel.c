@@ -0,0 +1,258 @@
+/* parallel.c
+ * Lexing one buffer on several threads.
+ *
+ * The buffer is cut at newlines into one segment per thread and each
+ * segment is lexed as if a token started at its first byte. That guess is
+ * usually right, but not always: the newline may be inside a block comment,
+ * or the operator check may need the type of the token before the cut.
+ * Working out the true state at a cut means lexing up to it, because the
+ * length limits on comments, strings and numbers decide where those tokens
+ * end, so the guess is checked afterwards instead.
+ *
+ * Stitching walks the segments in order with one sequential lexer. Where
+ * that lexer starts a call at the same offset, and with the same
+ * last_token_type, as a call in the next segment, everything from there on
+ * is the same and the segment's tokens are taken as they are. Until then the
+ * sequential lexer produces the tokens itself. Line numbers depend only on
+ * the offset (a newline is never inside any token except a block comment,
+ * which counts it), so a segment is lexed from line 1 and shifted by the
+ * number of newlines before it.
+ */
+#include "../../include/parallel.h"
+#include "counters.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Smallest segment worth a thread of its own */
+#ifndef PARALLEL_MIN_SEGMENT
+#define PARALLEL_MIN_SEGMENT (256 * 1024)
+#endif
+
+typedef struct {
+  CompactToken *tokens;
+  size_t count;
+  size_t capacity;
+} TokenArray;
+
+typedef struct {
+  const char *input;
+  size_t length;
+  size_t start;     // Offset of the first call
+  size_t end;       // Stop once a call would start here or later
+  TokenArray found; // Tokens, lines counted from 1 at start
+  size_t newlines;  // Newlines in [start, end)
+  Lexer lexer;      // State after the last token
+  LexerOptions options;
+  int failed;
+} Segment;
+
+static int push_token(TokenArray *array, CompactToken token) {
+  if (array->count == array->capacity) {
+    size_t capacity = array->capacity ? array->capacity * 2 : 1024;
+    CompactToken *tokens = realloc(array->tokens, capacity * sizeof(CompactToken));
+
+    if (tokens == NULL) {
+      return -1;
+    }
+    array->tokens = tokens;
+    array->capacity = capacity;
+  }
+  array->tokens[array->count++] = token;
+  return 0;
+}
+
+static void *lex_segment(void *argument) {
+  Segment *segment = argument;
+  Lexer *lexer = &segment->lexer;
+  const char *p = segment->input + segment->start;
+  const char *stop = segment->input + segment->end;
+  CompactToken token;
+
+  while ((p = memchr(p, '\n', stop - p)) != NULL) {
+    segment->newlines++;
+    p++;
+  }
+
+  lexer_init(lexer, segment->input, segment->length);
+  lexer->options = segment->options;
+  lexer->pos = segment->start;
+  lexer->line_start = segment->start;
+
+  // the last segment runs on to EOF, the others stop at the next cut
+  do {
+    token = scan_token(lexer);
+    if (push_token(&segment->found, token) != 0) {
+      segment->failed = 1;
+      break;
+    }
+  } while (segment->end == segment->length ? token.type != TOKEN_EOF : lexer->pos < segment->end);
+
+  return NULL;
+}
+
+/* Everything the stitching loop carries from one segment to the next */
+typedef struct {
+  Lexer lexer;        // Sequential lexer, where the output has got to
+  TokenArray output;
+  LexerOptions options;
+  int done;           // EOF has been output
+  int failed;
+} Stitch;
+
+/* Add a token to the output, shifting its line by line_shift */
+static void emit(Stitch *stitch, CompactToken token, uint32_t line_shift) {
+  token.line += line_shift;
+  if (token.type == TOKEN_EOF) {
+    stitch->done = 1;
+  }
+  if (stitch->options.skip_comments && token.type == TOKEN_COMMENT) {
+    return;
+  }
+  if (push_token(&stitch->output, token) != 0) {
+    stitch->failed = 1;
+    stitch->done = 1;
+  }
+}
+
+/* Output segment's tokens, lexing sequentially until the two agree */
+static void stitch_segment(Stitch *stitch, const Segment *segment, uint32_t line_shift) {
+  Lexer *lexer = &stitch->lexer;
+  size_t start = segment->start; // Where the segment's next call started
+  char last = 'x';               // and its last_token_type then
+  size_t i = 0;
+
+  while (!stitch->done && i < segment->found.count) {
+    CompactToken token = segment->found.tokens[i];
+
+    if (start < lexer->pos) {
+      // already covered by the sequential lexer
+      STATS_UNCOUNT(token, segment->input, start, 0);
+      last = last_type_after(last, token);
+      start = token.offset + token.length;
+      i++;
+    } else if (start == lexer->pos && last == lexer->last_token_type) {
+      // same state from here on, so the rest of the segment is right
+      for (; i < segment->found.count && !stitch->done; i++) {
+        emit(stitch, segment->found.tokens[i], line_shift);
+      }
+      *lexer = segment->lexer;
+      lexer->line += line_shift;
+      return;
+    } else {
+      emit(stitch, scan_token(lexer), 0);
+    }
+  }
+
+  // the sequential lexer reached the end without getting back in step
+  for (; i < segment->found.count; i++) {
+    STATS_UNCOUNT(segment->found.tokens[i], segment->input, start, 0);
+    start = segment->found.tokens[i].offset + segment->found.tokens[i].length;
+  }
+}
+
+CompactToken *lex_parallel(const char *input, size_t length, LexerOptions options, int jobs, size_t *count) {
+  Segment *segments;
+  pthread_t *threads;
+  int *started;
+  Stitch stitch;
+  size_t segment_count;
+  size_t cut = 0;
+  size_t n;
+  uint32_t line_shift = 0;
+
+  if (jobs <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = cpus > 0 ? (int)cpus : 1;
+  }
+  segment_count = length / PARALLEL_MIN_SEGMENT;
+  if (segment_count > (size_t)jobs) {
+    segment_count = jobs;
+  }
+  if (segment_count == 0) {
+    segment_count = 1;
+  }
+
+  segments = calloc(segment_count, sizeof(Segment));
+  threads = calloc(segment_count, sizeof(pthread_t));
+  started = calloc(segment_count, sizeof(int));
+  if (segments == NULL || threads == NULL || started == NULL) {
+    free(segments);
+    free(threads);
+    free(started);
+    return NULL;
+  }
+
+  // cut just before the first newline after each even share of the input
+  for (n = 0; n < segment_count; n++) {
+    size_t target = (n + 1) * (length / segment_count);
+    const char *newline;
+
+    if (target <= cut) {
+      target = cut + 1;
+    }
+    segments[n].input = input;
+    segments[n].length = length;
+    segments[n].options = options;
+    segments[n].start = cut;
+    if (n + 1 < segment_count && target < length &&
+        (newline = memchr(input + target, '\n', length - target)) != NULL) {
+      cut = newline - input;
+    } else {
+      cut = length;
+    }
+    segments[n].end = cut;
+    if (cut == length) {
+      segment_count = n + 1;
+    }
+  }
+
+  for (n = 1; n < segment_count; n++) {
+    started[n] = pthread_create(&threads[n], NULL, lex_segment, &segments[n]) == 0;
+  }
+  lex_segment(&segments[0]);
+  for (n = 1; n < segment_count; n++) {
+    if (started[n]) {
+      pthread_join(threads[n], NULL);
+    } else {
+      lex_segment(&segments[n]);
+    }
+  }
+
+  memset(&stitch, 0, sizeof(stitch));
+  stitch.options = options;
+  stitch.lexer = segments[0].lexer;
+  for (n = 0; n < segment_count; n++) {
+    stitch.failed |= segments[n].failed;
+  }
+
+  // the first segment started in the right state, so it's taken whole
+  if (!stitch.failed) {
+    for (n = 0; n < segments[0].found.count && !stitch.done; n++) {
+      emit(&stitch, segments[0].found.tokens[n], 0);
+    }
+    line_shift = (uint32_t)segments[0].newlines;
+    for (n = 1; n < segment_count; n++) {
+      stitch_segment(&stitch, &segments[n], line_shift);
+      line_shift += (uint32_t)segments[n].newlines;
+    }
+    while (!stitch.done) {
+      emit(&stitch, scan_token(&stitch.lexer), 0);
+    }
+  }
+
+  for (n = 0; n < segment_count; n++) {
+    free(segments[n].found.tokens);
+  }
+  free(segments);
+  free(threads);
+  free(started);
+
+  if (stitch.failed) {
+    free(stitch.output.tokens);
+    return NULL;
+  }
+  *count = stitch.output.count;
+  return stitch.output.tokens;
+}
@@ -0,0 +1,505 @@
+/* scan.c */
+#include "scan.h"
+#include "charclass.h"
+#include "utf8.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_X86 0
+#endif
+
+/* Scalar versions, also used for the tail the vector loops leave behind */
+
+static size_t skip_whitespace_scalar(const char *input, size_t pos, size_t end,
+                                     NewlineCount *lines) {
+  char c;
+
+  while (pos < end && (CHAR_CLASS(c = input[pos]) & CC_WHITESPACE)) {
+    if (c == '\n' && lines != NULL) {
+      lines->count++;
+      lines->last = pos;
+    }
+    pos++;
+  }
+  return pos;
+}
+
+static size_t find_comment_end_scalar(const char *input, size_t pos, size_t end,
+                                      NewlineCount *lines) {
+  char c;
+
+  while (pos < end) {
+    c = input[pos];
+    if (c == '\n' && lines != NULL) {
+      lines->count++;
+      lines->last = pos;
+    } else if (c == '*' && pos + 1 < end && input[pos + 1] == '/') {
+      return pos;
+    }
+    pos++;
+  }
+  return end;
+}
+
+static size_t find_line_end_scalar(const char *input, size_t pos, size_t end) {
+  char c;
+
+  while (pos < end && (c = input[pos]) != '\n' && c != '\r' && c != '\0') {
+    pos++;
+  }
+  return pos;
+}
+
+static size_t find_string_end_scalar(const char *input, size_t pos, size_t end) {
+  char c;
+
+  while (pos < end && (c = input[pos]) != '"' && c != '\n' && c != '\r' && c != '\0') {
+    pos++;
+  }
+  return pos;
+}
+
+static size_t find_newlines_scalar(const char *input, size_t pos, size_t end, uint32_t *starts) {
+  const char *next = input + pos;
+  size_t count = 0;
+
+  while ((next = memchr(next, '\n', input + end - next)) != NULL) {
+    starts[count++] = (uint32_t)(++next - input);
+  }
+  return count;
+}
+
+static size_t find_invalid_utf8_scalar(const char *input, size_t pos, size_t end) {
+  uint32_t code_point;
+  size_t length;
+
+  while (pos < end) {
+    if ((unsigned char)input[pos] < 0x80) {
+      pos++;
+      continue;
+    }
+    length = utf8_decode(input, pos, end, &code_point);
+    if (length == 0) {
+      return pos;
+    }
+    pos += length;
+  }
+  return end;
+}
+
+/* Where to go back to to check the bytes from pos on one at a time: the
+ * start of the character pos is in, given that everything before pos is
+ * well-formed
+ */
+static size_t character_start(const char *input, size_t start, size_t pos) {
+  size_t back = pos;
+
+  while (back > start && pos - back < 3 && ((unsigned char)input[back - 1] & 0xC0) == 0x80) {
+    back--;
+  }
+  if (back > start && (unsigned char)input[back - 1] >= 0xC0) {
+    back--;
+  }
+  return back;
+}
+
+static const ScanOps scalar_ops = {"scalar",          skip_whitespace_scalar, find_comment_end_scalar,
+                                   find_line_end_scalar, find_string_end_scalar, find_newlines_scalar,
+                                   find_invalid_utf8_scalar};
+
+#if SCAN_X86
+
+/* Add the newlines in mask (bit i = byte base + i) to lines */
+static inline void count_newlines(NewlineCount *lines, size_t base, unsigned mask) {
+  if (mask && lines != NULL) {
+    lines->count += __builtin_popcount(mask);
+    lines->last = base + 31 - __builtin_clz(mask);
+  }
+}
+
+/* Bits below bit index */
+#define BITS_BELOW(index) ((1u << (index)) - 1)
+
+/* Write the line starts after the newlines in mask to starts */
+static inline size_t put_newlines(uint32_t *starts, size_t base, unsigned mask) {
+  size_t count = 0;
+
+  while (mask) {
+    starts[count++] = (uint32_t)(base + __builtin_ctz(mask) + 1);
+    mask &= mask - 1;
+  }
+  return count;
+}
+
+#ifdef __SSE2__
+
+static size_t skip_whitespace_sse2(const char *input, size_t pos, size_t end,
+                                   NewlineCount *lines) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i nl = _mm_set1_epi8('\n');
+
+  while (pos + 16 <= end) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(input + pos));
+    unsigned newline = _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+    unsigned blank = _mm_movemask_epi8(_mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)),
+        _mm_cmpeq_epi8(block, cr)));
+    unsigned stop = ~(newline | blank) & 0xFFFF;
+
+    if (stop) {
+      unsigned index = __builtin_ctz(stop);
+      count_newlines(lines, pos, newline & BITS_BELOW(index));
+      return pos + index;
+    }
+    count_newlines(lines, pos, newline);
+    pos += 16;
+  }
+  return skip_whitespace_scalar(input, pos, end, lines);
+}
+
+static size_t find_comment_end_sse2(const char *input, size_t pos, size_t end,
+                                    NewlineCount *lines) {
+  const __m128i star = _mm_set1_epi8('*');
+  const __m128i slash = _mm_set1_epi8('/');
+  const __m128i nl = _mm_set1_epi8('\n');
+
+  // the second load reads one byte ahead to pair each '*' with the next byte
+  while (pos + 17 <= end) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(input + pos));
+    __m128i next = _mm_loadu_si128((const __m128i *)(input + pos + 1));
+    unsigned newline = _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+    unsigned close = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(block, star), _mm_cmpeq_epi8(next, slash)));
+
+    if (close) {
+      unsigned index = __builtin_ctz(close);
+      count_newlines(lines, pos, newline & BITS_BELOW(index));
+      return pos + index;
+    }
+    count_newlines(lines, pos, newline);
+    pos += 16;
+  }
+  return find_comment_end_scalar(input, pos, end, lines);
+}
+
+static size_t find_line_end_sse2(const char *input, size_t pos, size_t end) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i nul = _mm_setzero_si128();
+
+  while (pos + 16 <= end) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(input + pos));
+    unsigned stop = _mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, nl), _mm_cmpeq_epi8(block, cr)),
+                     _mm_cmpeq_epi8(block, nul)));
+
+    if (stop) {
+      return pos + __builtin_ctz(stop);
+    }
+    pos += 16;
+  }
+  return find_line_end_scalar(input, pos, end);
+}
+
+static size_t find_string_end_sse2(const char *input, size_t pos, size_t end) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i nul = _mm_setzero_si128();
+
+  while (pos + 16 <= end) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(input + pos));
+    unsigned stop = _mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, nl)),
+                     _mm_or_si128(_mm_cmpeq_epi8(block, cr), _mm_cmpeq_epi8(block, nul))));
+
+    if (stop) {
+      return pos + __builtin_ctz(stop);
+    }
+    pos += 16;
+  }
+  return find_string_end_scalar(input, pos, end);
+}
+
+static size_t find_newlines_sse2(const char *input, size_t pos, size_t end, uint32_t *starts) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t count = 0;
+
+  while (pos + 16 <= end) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(input + pos));
+
+    count += put_newlines(starts + count, pos, _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl)));
+    pos += 16;
+  }
+  return count + find_newlines_scalar(input, pos, end, starts + count);
+}
+
+/* SSE2 has no byte shuffle for the table lookups the AVX2 version does, so
+ * this one only skips ASCII 16 bytes at a time and decodes the rest
+ */
+static size_t find_invalid_utf8_sse2(const char *input, size_t pos, size_t end) {
+  uint32_t code_point;
+  size_t length;
+
+  while (pos + 16 <= end) {
+    unsigned high = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(input + pos)));
+
+    if (high == 0) {
+      pos += 16;
+      continue;
+    }
+
+    // decode from the first non-ASCII byte until back in ASCII
+    pos += __builtin_ctz(high);
+    while (pos < end && (unsigned char)input[pos] >= 0x80) {
+      length = utf8_decode(input, pos, end, &code_point);
+      if (length == 0) {
+        return pos;
+      }
+      pos += length;
+    }
+  }
+  return find_invalid_utf8_scalar(input, pos, end);
+}
+
+static const ScanOps sse2_ops = {"sse2",          skip_whitespace_sse2, find_comment_end_sse2,
+                                 find_line_end_sse2, find_string_end_sse2, find_newlines_sse2,
+                                 find_invalid_utf8_sse2};
+
+#endif /* __SSE2__ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static size_t skip_whitespace_avx2(const char *input, size_t pos, size_t end,
+                                        NewlineCount *lines) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i nl = _mm256_set1_epi8('\n');
+
+  while (pos + 32 <= end) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(input + pos));
+    unsigned newline = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl));
+    unsigned blank = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(block, tab)),
+        _mm256_cmpeq_epi8(block, cr)));
+    unsigned stop = ~(newline | blank);
+
+    if (stop) {
+      unsigned index = __builtin_ctz(stop);
+      count_newlines(lines, pos, newline & BITS_BELOW(index));
+      return pos + index;
+    }
+    count_newlines(lines, pos, newline);
+    pos += 32;
+  }
+  return skip_whitespace_scalar(input, pos, end, lines);
+}
+
+AVX2 static size_t find_comment_end_avx2(const char *input, size_t pos, size_t end,
+                                         NewlineCount *lines) {
+  const __m256i star = _mm256_set1_epi8('*');
+  const __m256i slash = _mm256_set1_epi8('/');
+  const __m256i nl = _mm256_set1_epi8('\n');
+
+  while (pos + 33 <= end) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(input + pos));
+    __m256i next = _mm256_loadu_si256((const __m256i *)(input + pos + 1));
+    unsigned newline = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl));
+    unsigned close = (unsigned)_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(block, star), _mm256_cmpeq_epi8(next, slash)));
+
+    if (close) {
+      unsigned index = __builtin_ctz(close);
+      count_newlines(lines, pos, newline & BITS_BELOW(index));
+      return pos + index;
+    }
+    count_newlines(lines, pos, newline);
+    pos += 32;
+  }
+  return find_comment_end_scalar(input, pos, end, lines);
+}
+
+AVX2 static size_t find_line_end_avx2(const char *input, size_t pos, size_t end) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i nul = _mm256_setzero_si256();
+
+  while (pos + 32 <= end) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(input + pos));
+    unsigned stop = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, nl), _mm256_cmpeq_epi8(block, cr)),
+        _mm256_cmpeq_epi8(block, nul)));
+
+    if (stop) {
+      return pos + __builtin_ctz(stop);
+    }
+    pos += 32;
+  }
+  return find_line_end_scalar(input, pos, end);
+}
+
+AVX2 static size_t find_string_end_avx2(const char *input, size_t pos, size_t end) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i nl = _mm256_set1_epi8('\n');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i nul = _mm256_setzero_si256();
+
+  while (pos + 32 <= end) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(input + pos));
+    unsigned stop = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, nl)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, cr), _mm256_cmpeq_epi8(block, nul))));
+
+    if (stop) {
+      return pos + __builtin_ctz(stop);
+    }
+    pos += 32;
+  }
+  return find_string_end_scalar(input, pos, end);
+}
+
+AVX2 static size_t find_newlines_avx2(const char *input, size_t pos, size_t end, uint32_t *starts) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t count = 0;
+
+  while (pos + 32 <= end) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(input + pos));
+
+    count += put_newlines(starts + count, pos, (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl)));
+    pos += 32;
+  }
+  return count + find_newlines_scalar(input, pos, end, starts + count);
+}
+
+/* What can be wrong with a pair of bytes, as bits of the three lookups in
+ * find_invalid_utf8_avx2 (from Keiser and Lemire, "Validating UTF-8 In Less
+ * Than One Instruction Per Byte")
+ */
+#define UTF8_TOO_SHORT 0x01   // A lead byte not followed by a continuation
+#define UTF8_TOO_LONG 0x02    // A continuation after an ASCII byte
+#define UTF8_OVERLONG_3 0x04  // E0 followed by 80-9F
+#define UTF8_TOO_LARGE 0x08   // Past U+10FFFF
+#define UTF8_SURROGATE 0x10   // ED followed by A0-BF
+#define UTF8_OVERLONG_2 0x20  // C0 or C1
+#define UTF8_TOO_LARGE_1000 0x40 // F5 and up followed by 80-8F
+#define UTF8_OVERLONG_4 0x40  // F0 followed by 80-8F
+#define UTF8_TWO_CONTS 0x80   // Two continuations in a row, checked against the lead byte before them
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+/* Bytes n places back, the first of them from the end of previous */
+#define BYTES_BACK(block, previous, n) \
+  _mm256_alignr_epi8(block, _mm256_permute2x128_si256(previous, block, 0x21), 16 - (n))
+
+#define LOOKUP16(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+AVX2 static size_t find_invalid_utf8_avx2(const char *input, size_t pos, size_t end) {
+  // indexed by the high nibble of the first byte of each pair
+  const __m256i first_high = LOOKUP16(
+      UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+      UTF8_TOO_LONG, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+      UTF8_TOO_SHORT | UTF8_OVERLONG_2, UTF8_TOO_SHORT, UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+      UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+  // by its low nibble
+  const __m256i first_low = LOOKUP16(
+      UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4, UTF8_CARRY | UTF8_OVERLONG_2, UTF8_CARRY,
+      UTF8_CARRY, UTF8_CARRY | UTF8_TOO_LARGE, UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+      UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+      UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+      UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+      UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+      UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+      UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000, UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000);
+  // by the high nibble of the second byte
+  const __m256i second_high = LOOKUP16(
+      UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+      UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+      UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+      UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+      UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+      UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE, UTF8_TOO_SHORT,
+      UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  // no sequence is left open if the last three bytes are at most these
+  const __m256i open_limit = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                              -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1),
+                                              (char)(0xE0 - 1), (char)(0xC0 - 1));
+  __m256i previous = _mm256_setzero_si256();
+  __m256i open = _mm256_setzero_si256();
+  size_t start = pos;
+
+  while (pos + 32 <= end) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(input + pos));
+    __m256i error;
+
+    if (_mm256_movemask_epi8(block) == 0) {
+      // all ASCII, which is only wrong if the block before left a sequence open
+      error = open;
+      open = _mm256_setzero_si256();
+    } else {
+      __m256i back1 = BYTES_BACK(block, previous, 1);
+      __m256i pairs = _mm256_and_si256(
+          _mm256_and_si256(
+              _mm256_shuffle_epi8(first_high, _mm256_and_si256(_mm256_srli_epi16(back1, 4), nibble)),
+              _mm256_shuffle_epi8(first_low, _mm256_and_si256(back1, nibble))),
+          _mm256_shuffle_epi8(second_high, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble)));
+      // the third and fourth bytes of three and four byte sequences must be
+      // continuations, and nothing else may follow a continuation
+      __m256i third = _mm256_subs_epu8(BYTES_BACK(block, previous, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+      __m256i fourth = _mm256_subs_epu8(BYTES_BACK(block, previous, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+      __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+
+      error = _mm256_xor_si256(must_continue, pairs);
+      open = _mm256_subs_epu8(block, open_limit);
+    }
+    if (!_mm256_testz_si256(error, error)) {
+      // find exactly where, from the start of the character the block began in
+      return find_invalid_utf8_scalar(input, character_start(input, start, pos), end);
+    }
+    previous = block;
+    pos += 32;
+  }
+  return find_invalid_utf8_scalar(input, character_start(input, start, pos), end);
+}
+
+static const ScanOps avx2_ops = {"avx2",          skip_whitespace_avx2, find_comment_end_avx2,
+                                 find_line_end_avx2, find_string_end_avx2, find_newlines_avx2,
+                                 find_invalid_utf8_avx2};
+
+#endif /* SCAN_X86 */
+
+const ScanOps *scan_ops_best(void) {
+#if SCAN_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return &avx2_ops;
+  }
+#ifdef __SSE2__
+  return &sse2_ops;
+#endif
+#endif
+  return &scalar_ops;
+}
+
+const ScanOps *scan_ops_scalar(void) {
+  return &scalar_ops;
+}
+
+size_t scan_ops_supported(const ScanOps **ops) {
+  size_t count = 0;
+
+  ops[count++] = &scalar_ops;
+#if SCAN_X86
+#ifdef __SSE2__
+  ops[count++] = &sse2_ops;
+#endif
+  if (__builtin_cpu_supports("avx2")) {
+    ops[count++] = &avx2_ops;
+  }
+#endif
+  return count;
+}
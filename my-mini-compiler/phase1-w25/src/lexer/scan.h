@@ -0,0 +1,62 @@
+/* scan.h */
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Newlines passed over by a scan */
+typedef struct {
+  size_t count; // How many
+  size_t last;  // Offset of the last one, valid when count > 0
+} NewlineCount;
+
+/* The loops that walk over runs of bytes without producing tokens
+ * Each has a scalar version and, on x86, SSE2 and AVX2 versions that look at
+ * 16 or 32 bytes at a time. All of them stop at end and never read past it.
+ * The ones that count newlines skip counting if lines is NULL.
+ */
+typedef struct ScanOps {
+  const char *name;
+
+  /* Offset of the first non-whitespace byte at or after pos (or end) */
+  size_t (*skip_whitespace)(const char *input, size_t pos, size_t end, NewlineCount *lines);
+
+  /* Offset of the '*' of the first closing delimiter at or after pos, or end
+   * if the comment isn't closed. Newlines up to there are counted.
+   */
+  size_t (*find_comment_end)(const char *input, size_t pos, size_t end, NewlineCount *lines);
+
+  /* Offset of the first '\n', '\r' or '\0' at or after pos, or end */
+  size_t (*find_line_end)(const char *input, size_t pos, size_t end);
+
+  /* Offset of the first '"', '\n', '\r' or '\0' at or after pos, or end */
+  size_t (*find_string_end)(const char *input, size_t pos, size_t end);
+
+  /* Write the offset just past each '\n' from pos to end to starts, which
+   * has room for end - pos of them, and return how many there were
+   */
+  size_t (*find_newlines)(const char *input, size_t pos, size_t end, uint32_t *starts);
+
+  /* Offset of the first byte of the first sequence at or after pos that
+   * isn't well-formed UTF-8 (see utf8_decode), or end. pos must be where a
+   * character starts. Runs of ASCII are skipped a block at a time.
+   */
+  size_t (*find_invalid_utf8)(const char *input, size_t pos, size_t end);
+} ScanOps;
+
+/* Fastest implementation this CPU supports */
+const ScanOps *scan_ops_best(void);
+
+/* Plain byte-at-a-time implementation */
+const ScanOps *scan_ops_scalar(void);
+
+/* Most implementations scan_ops_supported can give */
+#define SCAN_OPS_COUNT 3
+
+/* Write every implementation this CPU supports to ops, scalar first, and
+ * return how many there are
+ */
+size_t scan_ops_supported(const ScanOps **ops);
+
+#endif /* SCAN_H */
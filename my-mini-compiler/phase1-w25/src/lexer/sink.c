@@ -0,0 +1,141 @@
+/* sink.c */
+#include "../../include/sink.h"
+#include "../../include/lexer.h"
+#include <stdio.h>
+#include <string.h>
+
+void sink_init(TokenSink *sink, SinkWrite write, void *context, int quiet) {
+  sink->write = write;
+  sink->context = context;
+  sink->quiet = quiet;
+  sink->errors_apart = 0;
+  sink->used = 0;
+  sink->tokens = 0;
+  sink->errors = 0;
+}
+
+void sink_flush(TokenSink *sink) {
+  if (sink->used > 0) {
+    sink->write(sink->context, sink->buffer, sink->used);
+    sink->used = 0;
+  }
+}
+
+void sink_write(TokenSink *sink, const char *data, size_t size) {
+  // anything bigger than the buffer goes straight through
+  if (sink->used + size > SINK_BUFFER_SIZE) {
+    sink_flush(sink);
+    if (size > SINK_BUFFER_SIZE) {
+      sink->write(sink->context, data, size);
+      return;
+    }
+  }
+  memcpy(sink->buffer + sink->used, data, size);
+  sink->used += size;
+}
+
+static void sink_text(TokenSink *sink, const char *text) {
+  sink_write(sink, text, strlen(text));
+}
+
+static void sink_int(TokenSink *sink, long value) {
+  char digits[24];
+  char *p = digits + sizeof(digits);
+  unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+
+  do {
+    *--p = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude > 0);
+  if (value < 0) {
+    *--p = '-';
+  }
+  sink_write(sink, p, digits + sizeof(digits) - p);
+}
+
+void sink_token(TokenSink *sink, CompactToken token, const char *text, size_t text_length) {
+  size_t length = text_length < token.length ? text_length : token.length;
+
+  sink->tokens++;
+  if (token.error != ERROR_NONE) {
+    sink->errors++;
+  }
+  if (sink->quiet || (sink->errors_apart && token.error != ERROR_NONE)) {
+    return;
+  }
+
+  // the same lexeme print_token would show
+  if (token.type == TOKEN_EOF) {
+    text = "EOF";
+    length = 3;
+  } else {
+    const char *nul;
+
+    // a NUL byte ends the lexeme there, as it does for a printed Token
+    nul = memchr(text, '\0', length);
+    if (nul != NULL) {
+      length = nul - text;
+    }
+  }
+
+  if (token.error != ERROR_NONE) {
+    sink_text(sink, "Lexical Error at line ");
+    sink_int(sink, token.line);
+    sink_text(sink, ": ");
+    sink_text(sink, error_message((ErrorType)token.error));
+    if (token.error == ERROR_INVALID_CHAR) {
+      sink_text(sink, " '");
+      sink_write(sink, text, length);
+      sink_text(sink, "'");
+    }
+    sink_text(sink, "\n");
+    return;
+  }
+
+  sink_text(sink, "Token: ");
+  sink_text(sink, token_type_name((TokenType)token.type));
+  sink_text(sink, " | Lexeme: '");
+  sink_write(sink, text, length);
+  sink_text(sink, "' | Line: ");
+  sink_int(sink, token.line);
+  sink_text(sink, "\n");
+}
+
+void sink_diagnostics(TokenSink *sink, const Diagnostics *diagnostics, const char *input, int errors) {
+  size_t i;
+
+  for (i = 0; i < diagnostics->count; i++) {
+    const Diagnostic *diagnostic = &diagnostics->items[i];
+    const char *text = input + diagnostic->offset;
+    const char *nul = memchr(text, '\0', diagnostic->length);
+    char code[3];
+
+    if (diagnostic->severity == SEVERITY_ERROR && !errors) {
+      continue;
+    }
+    code[0] = (char)('0' + diagnostic->code / 10 % 10);
+    code[1] = (char)('0' + diagnostic->code % 10);
+    code[2] = '\0';
+
+    sink_text(sink, severity_name(diagnostic->severity));
+    sink_text(sink, " E");
+    sink_text(sink, code);
+    sink_text(sink, " at line ");
+    sink_int(sink, diagnostic->line);
+    sink_text(sink, ", column ");
+    sink_int(sink, diagnostic->column);
+    sink_text(sink, ": ");
+    sink_text(sink, error_message(diagnostic->code));
+    if (diagnostic->length > 0) {
+      // the span as a lexeme, stopping at a NUL byte like one
+      sink_text(sink, " '");
+      sink_write(sink, text, nul ? (size_t)(nul - text) : diagnostic->length);
+      sink_text(sink, "'");
+    }
+    sink_text(sink, "\n");
+  }
+}
+
+void sink_write_file(void *file, const char *data, size_t size) {
+  fwrite(data, 1, size, (FILE *)file);
+}
@@ -0,0 +1,193 @@
+/* source.c */
+#include "../../include/source.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Read a file that can't seek (a pipe, a FIFO) to its end, growing a heap
+ * buffer as it goes
+ */
+static int source_read_all(SourceFile *source, FILE *file) {
+  size_t capacity = 64 * 1024;
+  size_t length = 0;
+  char *buffer = malloc(capacity);
+  size_t got;
+
+  while (buffer != NULL && (got = fread(buffer + length, 1, capacity - length, file)) > 0) {
+    length += got;
+    if (length > SOURCE_MAX_LENGTH) {
+      free(buffer);
+      errno = EFBIG;
+      return -1;
+    }
+    if (length == capacity) {
+      char *bigger = realloc(buffer, capacity * 2);
+
+      if (bigger == NULL) {
+        free(buffer);
+      }
+      buffer = bigger;
+      capacity *= 2;
+    }
+  }
+  if (buffer == NULL || ferror(file)) {
+    free(buffer);
+    return -1;
+  }
+
+  source->data = buffer;
+  source->length = length;
+  source->mapped = 0;
+  source->in_arena = 0;
+  return 0;
+}
+
+/* Read all of an open file into a heap buffer, or arena if it's set, and
+ * close it. A read error, or a file that comes up shorter than its size
+ * (cut short while it was read), fails rather than give part of it.
+ */
+static int source_read_file(SourceFile *source, FILE *file, Arena *arena) {
+  long file_size;
+  char *buffer;
+  int status;
+
+  // get file size, which a pipe doesn't have
+  if (fseek(file, 0, SEEK_END) != 0 || (file_size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+    clearerr(file);
+    status = source_read_all(source, file);
+    fclose(file);
+    return status;
+  }
+  if ((unsigned long)file_size > SOURCE_MAX_LENGTH) {
+    fclose(file);
+    errno = EFBIG;
+    return -1;
+  }
+
+  if (arena != NULL) {
+    buffer = arena_alloc(arena, file_size > 0 ? file_size : 1);
+  } else {
+    buffer = malloc(file_size > 0 ? file_size : 1);
+  }
+  if (!buffer) {
+    fclose(file);
+    return -1;
+  }
+
+  if (fread(buffer, 1, (size_t)file_size, file) != (size_t)file_size) {
+    // what came from the arena goes when it does
+    if (arena == NULL) {
+      free(buffer);
+    }
+    if (!ferror(file)) {
+      errno = EIO;
+    }
+    fclose(file);
+    return -1;
+  }
+
+  source->data = buffer;
+  source->length = (size_t)file_size;
+  source->mapped = 0;
+  source->in_arena = arena != NULL;
+  fclose(file);
+  return 0;
+}
+
+/* Read the whole file into a heap buffer, or arena if it's set */
+static int source_read(SourceFile *source, const char *path, Arena *arena) {
+  FILE *file = fopen(path, "rb");
+
+  if (file == NULL) {
+    return -1;
+  }
+  return source_read_file(source, file, arena);
+}
+
+#ifndef _WIN32
+/* Map the file read-only */
+static int source_map(SourceFile *source, const char *path, Arena *arena) {
+  struct stat info;
+  void *data;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (fstat(fd, &info) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  if ((unsigned long long)info.st_size > SOURCE_MAX_LENGTH) {
+    close(fd);
+    errno = EFBIG;
+    return -1;
+  }
+
+  // mmap can't map an empty file, or a pipe, which reports no size; a FIFO
+  // is read through the descriptor already open, as opening it again would
+  // wait for another writer
+  if (info.st_size == 0 || !S_ISREG(info.st_mode)) {
+    FILE *file = fdopen(fd, "rb");
+
+    if (file == NULL) {
+      close(fd);
+      return -1;
+    }
+    return source_read_file(source, file, arena);
+  }
+
+  data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+
+  // the lexer reads front to back exactly once
+  madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+  source->data = data;
+  source->length = (size_t)info.st_size;
+  source->mapped = 1;
+  source->in_arena = 0;
+  return 0;
+}
+#endif
+
+int source_open(SourceFile *source, const char *path, int use_mmap, Arena *arena) {
+#ifndef _WIN32
+  if (use_mmap) {
+    return source_map(source, path, arena);
+  }
+#else
+  (void)use_mmap;
+#endif
+  return source_read(source, path, arena);
+}
+
+void source_close(SourceFile *source) {
+#ifndef _WIN32
+  if (source->mapped) {
+    munmap((void *)source->data, source->length);
+  } else if (!source->in_arena) {
+    free((void *)source->data);
+  }
+#else
+  if (!source->in_arena) {
+    free((void *)source->data);
+  }
+#endif
+  source->data = NULL;
+  source->length = 0;
+  source->mapped = 0;
+  source->in_arena = 0;
+}
@@ -0,0 +1,134 @@
+/* stats.c */
+#include "../../include/stats.h"
+#include "counters.h"
+
+#ifdef LEXER_STATS
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Thread_local Counters counters;
+
+static Counters totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t thread_key;
+static pthread_once_t setup_once = PTHREAD_ONCE_INIT;
+
+static const char *const branch_names[BRANCH_COUNT] = {
+    "whitespace", "line_comment", "block_comment", "number", "keyword", "identifier",
+    "string",     "operator",     "delimiter",     "invalid", "eof",        "relexed",
+};
+
+/* By ErrorType; ERROR_NONE counts tokens without an error */
+static const char *const error_names[] = {
+    "none",       "invalid_char",          "invalid_number_value", "invalid_number_format",
+    "consecutive_operators", "unterminated_string", "identifier_too_long", "invalid_utf8",
+};
+
+#define ERROR_NAME_COUNT (sizeof(error_names) / sizeof(error_names[0]))
+
+/* Move a thread's counts into the totals */
+static void merge(Counters *local) {
+  int i;
+
+  pthread_mutex_lock(&totals_lock);
+  for (i = 0; i < BRANCH_COUNT; i++) {
+    totals.branch[i].tokens += local->branch[i].tokens;
+    totals.branch[i].bytes += local->branch[i].bytes;
+    totals.branch[i].time += local->branch[i].time;
+  }
+  for (i = 0; i < 16; i++) {
+    totals.errors[i] += local->errors[i];
+  }
+  pthread_mutex_unlock(&totals_lock);
+
+  memset(local->branch, 0, sizeof(local->branch));
+  memset(local->errors, 0, sizeof(local->errors));
+}
+
+static void thread_done(void *local) {
+  merge(local);
+}
+
+static void write_at_exit(void) {
+  const char *format = getenv("LEXER_STATS");
+
+  lexer_stats_write(stderr, format != NULL && strcmp(format, "json") == 0);
+}
+
+static void setup(void) {
+  pthread_key_create(&thread_key, thread_done);
+  atexit(write_at_exit);
+}
+
+void counters_register(void) {
+  pthread_once(&setup_once, setup);
+  pthread_setspecific(thread_key, &counters);
+  counters.registered = 1;
+}
+
+static const char *error_name(int error, char *buffer) {
+  if ((size_t)error < ERROR_NAME_COUNT) {
+    return error_names[error];
+  }
+  sprintf(buffer, "error_%d", error);
+  return buffer;
+}
+
+int lexer_stats_write(FILE *out, int json) {
+  uint64_t tokens = 0;
+  char name[16];
+  int i;
+
+  merge(&counters);
+  pthread_mutex_lock(&totals_lock);
+
+  for (i = 1; i < BRANCH_RELEXED; i++) {
+    tokens += totals.branch[i].tokens;
+  }
+
+  if (json) {
+    fprintf(out, "{\"unit\": \"%s\", \"tokens\": %llu, \"recognizers\": {", STATS_UNIT, (unsigned long long)tokens);
+    for (i = 0; i < BRANCH_COUNT; i++) {
+      fprintf(out, "%s\"%s\": {\"count\": %llu, \"bytes\": %llu, \"time\": %llu}", i ? ", " : "", branch_names[i],
+              (unsigned long long)totals.branch[i].tokens, (unsigned long long)totals.branch[i].bytes,
+              (unsigned long long)totals.branch[i].time);
+    }
+    fprintf(out, "}, \"errors\": {");
+    for (i = 1; i < 16; i++) {
+      if (totals.errors[i] > 0 || (size_t)i < ERROR_NAME_COUNT) {
+        fprintf(out, "%s\"%s\": %llu", i > 1 ? ", " : "", error_name(i, name),
+                (unsigned long long)totals.errors[i]);
+      }
+    }
+    fprintf(out, "}}\n");
+  } else {
+    fprintf(out, "%-14s %12s %14s %16s %10s\n", "recognizer", "count", "bytes", STATS_UNIT, "per count");
+    for (i = 0; i < BRANCH_COUNT; i++) {
+      const BranchCounts *counts = &totals.branch[i];
+
+      fprintf(out, "%-14s %12llu %14llu %16llu %10.1f\n", branch_names[i], (unsigned long long)counts->tokens,
+              (unsigned long long)counts->bytes, (unsigned long long)counts->time,
+              counts->tokens ? (double)counts->time / counts->tokens : 0.0);
+    }
+    fprintf(out, "%-14s %12llu\n", "tokens", (unsigned long long)tokens);
+    for (i = 1; i < 16; i++) {
+      if (totals.errors[i] > 0) {
+        fprintf(out, "%-22s %12llu\n", error_name(i, name), (unsigned long long)totals.errors[i]);
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&totals_lock);
+  return 0;
+}
+
+#else
+
+int lexer_stats_write(FILE *out, int json) {
+  (void)out;
+  (void)json;
+  return -1;
+}
+
+#endif /* LEXER_STATS */
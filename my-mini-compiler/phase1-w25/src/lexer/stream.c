@@ -0,0 +1,327 @@
+/* stream.c */
+#include "../../include/stream.h"
+#include "../../include/symtab.h"
+#include "counters.h"
+#include "scan.h"
+#include "utf8.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Longest stream lexed, as compact token offsets are 32-bit */
+#ifndef STREAM_MAX_LENGTH
+#define STREAM_MAX_LENGTH 0xFFFFFFFFull
+#endif
+
+int stream_lexer_init(StreamLexer *stream, StreamRead read, void *context, size_t chunk_size) {
+  stream->read = read;
+  stream->context = context;
+  stream->chunk_size = chunk_size > 0 ? chunk_size : 1;
+  stream->capacity = 2 * stream->chunk_size;
+  stream->window = malloc(stream->capacity);
+  if (stream->window == NULL) {
+    return -1;
+  }
+  stream->window_length = 0;
+  stream->window_start = 0;
+  stream->at_end = 0;
+  stream->failed = 0;
+  stream->too_long = 0;
+  stream->text = NULL;
+  stream->text_length = 0;
+
+  // the lexer is pointed at the window once there's something in it
+  lexer_init(&stream->lexer, NULL, 0);
+  return 0;
+}
+
+void stream_lexer_free(StreamLexer *stream) {
+  free(stream->window);
+  stream->window = NULL;
+}
+
+size_t stream_read_file(void *file, char *buffer, size_t size) {
+  return fread(buffer, 1, size, (FILE *)file);
+}
+
+/* Drop the first drop bytes of the window and read the next chunk */
+static void stream_fill(StreamLexer *stream, size_t drop) {
+  Lexer *lexer = &stream->lexer;
+  unsigned long long room;
+  size_t got;
+
+  memmove(stream->window, stream->window + drop, stream->window_length - drop);
+  stream->window_length -= drop;
+  stream->window_start += drop;
+  lexer->pos -= drop;
+  // may wrap below zero when the line began before the window, the
+  // column (pos - line_start) still comes out right
+  lexer->line_start -= drop;
+
+  // a token longer than the window, make room for it
+  if (stream->capacity - stream->window_length < stream->chunk_size) {
+    size_t capacity = 2 * stream->capacity;
+    char *window = realloc(stream->window, capacity);
+
+    if (!window) {
+      stream->failed = 1;
+      stream->at_end = 1;
+      return;
+    }
+    stream->window = window;
+    stream->capacity = capacity;
+  }
+
+  // never read past STREAM_MAX_LENGTH, but do look for a byte after it
+  room = STREAM_MAX_LENGTH - (stream->window_start + stream->window_length);
+  got = stream->read(stream->context, stream->window + stream->window_length,
+                     room > 0 && room < stream->chunk_size ? (size_t)room : stream->chunk_size);
+  if (got > room) {
+    stream->too_long = 1;
+    got = (size_t)room;
+  }
+  if (got == 0) {
+    stream->at_end = 1;
+  }
+  stream->window_length += got;
+
+  lexer->input = stream->window;
+  lexer->length = stream->window_length;
+  // the UTF-8 checked so far was of the old window
+  lexer->utf8_from = 1;
+  lexer->utf8_error = 0;
+}
+
+/* Is this block comment token missing its closing delimiter? */
+static int comment_is_open(const StreamLexer *stream, CompactToken token) {
+  const char *text = stream->window + token.offset;
+
+  if (token.length < 2 || text[0] != '/' || text[1] != '*') {
+    return 0;
+  }
+  return token.length < 4 || text[token.length - 2] != '*' || text[token.length - 1] != '/';
+}
+
+/* Leave a '*' at the very end of the window for the next scan, the '/' that
+ * closes the comment may be the first byte of the next chunk
+ */
+static void keep_trailing_star(StreamLexer *stream, CompactToken *token, size_t min_length) {
+  if (token->length > min_length && stream->window[stream->window_length - 1] == '*') {
+    stream->lexer.pos--;
+    token->length--;
+  }
+}
+
+/* In UTF-8 mode, leave a character cut off at the end of the window for the
+ * next scan too, and check what's left of the piece without it
+ */
+static void keep_cut_character(StreamLexer *stream, CompactToken *token) {
+  Lexer *lexer = &stream->lexer;
+  size_t cut;
+
+  if (!lexer->options.utf8) {
+    return;
+  }
+  cut = utf8_cut_tail(stream->window, token->offset, token->offset + token->length);
+  if (cut > 0) {
+    lexer->pos -= cut;
+    token->length -= (uint32_t)cut;
+    if (token->error == ERROR_INVALID_UTF8 &&
+        lexer->scan->find_invalid_utf8(stream->window, token->offset, token->offset + token->length) ==
+            token->offset + token->length) {
+      token->error = ERROR_NONE;
+    }
+  }
+}
+
+/* Where the window's input ends for certain: its end, or in UTF-8 mode the
+ * start of a character cut off there, which the lexer may have stopped at
+ * only because the rest of it hasn't been read yet
+ */
+static size_t settled_end(const StreamLexer *stream) {
+  const Lexer *lexer = &stream->lexer;
+
+  if (!lexer->options.utf8 || lexer->pos >= stream->window_length) {
+    return stream->window_length;
+  }
+  return stream->window_length - utf8_cut_tail(stream->window, lexer->pos, stream->window_length);
+}
+
+/* Add piece, the next part of a token followed across windows, to whole,
+ * copying as much of it as still fits in head
+ */
+static void add_piece(StreamLexer *stream, CompactToken *whole, CompactToken piece) {
+  size_t room = MAX_LEXEME_SIZE - 1 - whole->length;
+
+  if (whole->length < MAX_LEXEME_SIZE - 1) {
+    memcpy(stream->head + whole->length, stream->window + piece.offset, piece.length < room ? piece.length : room);
+  }
+  whole->length += piece.length;
+  if (whole->error == ERROR_NONE) {
+    whole->error = piece.error;
+  }
+}
+
+/* The token followed across windows, now whole, starting at start */
+static CompactToken finish_whole(StreamLexer *stream, CompactToken whole, unsigned long long start) {
+  STATS_WHOLE_ERROR(whole.error);
+  whole.offset = (uint32_t)start;
+  stream->text = stream->head;
+  stream->text_length = whole.length < MAX_LEXEME_SIZE - 1 ? whole.length : MAX_LEXEME_SIZE - 1;
+  return whole;
+}
+
+static int is_invalid_run(CompactToken token) {
+  return token.type == TOKEN_ERROR && token.error == ERROR_INVALID_CHAR;
+}
+
+/* Move the lexer up to pos over whitespace it has already scanned,
+ * counting the lines it passes
+ */
+static void skip_whitespace_to(StreamLexer *stream, size_t pos) {
+  Lexer *lexer = &stream->lexer;
+  NewlineCount lines = {0, 0};
+
+  lexer->scan->skip_whitespace(stream->window, lexer->pos, pos, &lines);
+  lexer->pos = pos;
+  if (lines.count > 0) {
+    lexer->line += (int)lines.count;
+    lexer->line_start = lines.last + 1;
+  }
+}
+
+/* Tokens that may go on past the window are lexed again with the next chunk,
+ * except block comments and long runs of invalid characters, which have no
+ * length limit: they are followed from window to window a piece at a time,
+ * only their start kept in head.
+ */
+static CompactToken next_token(StreamLexer *stream) {
+  enum { FOLLOW_NONE, FOLLOW_COMMENT, FOLLOW_RUN } following = FOLLOW_NONE;
+  Lexer *lexer = &stream->lexer;
+  Lexer saved;
+  CompactToken token;
+  CompactToken whole = {0};
+  unsigned long long whole_start = 0;
+  size_t keep;
+
+  for (;;) {
+    saved = *lexer;
+    token = scan_token(lexer);
+
+    if (following == FOLLOW_COMMENT) {
+      // token is the next piece of a block comment
+      if (lexer->in_comment && !stream->at_end) {
+        CompactToken scanned = token;
+
+        keep_trailing_star(stream, &token, 0);
+        keep_cut_character(stream, &token);
+        STATS_PIECE(BRANCH_BLOCK_COMMENT, scanned.error, scanned.length - token.length, 0);
+        add_piece(stream, &whole, token);
+        stream_fill(stream, lexer->pos);
+        continue;
+      }
+
+      lexer->in_comment = 0;
+      STATS_PIECE(BRANCH_BLOCK_COMMENT, token.error, 0, 0);
+      add_piece(stream, &whole, token);
+      token = finish_whole(stream, whole, whole_start);
+      following = FOLLOW_NONE;
+    } else if (following == FOLLOW_RUN) {
+      if (token.offset != saved.pos || !is_invalid_run(token)) {
+        // the run stopped at the end of the last window, what comes after it
+        // is lexed again on the next call
+        STATS_UNCOUNT(token, stream->window, saved.pos, 0);
+        *lexer = saved;
+      } else if (!stream->at_end && lexer->pos >= settled_end(stream)) {
+        CompactToken scanned = token;
+
+        keep_cut_character(stream, &token);
+        STATS_PIECE(BRANCH_INVALID, scanned.error, scanned.length - token.length, 0);
+        add_piece(stream, &whole, token);
+        stream_fill(stream, lexer->pos);
+        continue;
+      } else {
+        STATS_PIECE(BRANCH_INVALID, token.error, 0, 0);
+        add_piece(stream, &whole, token);
+      }
+      token = finish_whole(stream, whole, whole_start);
+      following = FOLLOW_NONE;
+    } else if (stream->at_end || lexer->pos < settled_end(stream)) {
+      // the lexer stopped before the end of the window, so nothing in the
+      // next chunk can change this token
+      stream->text = stream->window + token.offset;
+      stream->text_length = token.length;
+      token.offset = (uint32_t)(stream->window_start + token.offset);
+    } else if (token.type == TOKEN_COMMENT && comment_is_open(stream, token)) {
+      // follow the comment into the next chunk instead of holding all of it
+      CompactToken piece = token;
+
+      whole = token;
+      whole.length = 0;
+      whole.error = ERROR_NONE;
+      whole_start = stream->window_start + token.offset;
+      keep_trailing_star(stream, &piece, 2);
+      keep_cut_character(stream, &piece);
+      STATS_PIECE(BRANCH_BLOCK_COMMENT, token.error, token.length - piece.length, 1);
+      add_piece(stream, &whole, piece);
+      lexer->in_comment = 1;
+      following = FOLLOW_COMMENT;
+      stream_fill(stream, lexer->pos);
+      continue;
+    } else {
+      CompactToken piece = token;
+
+      // a run of invalid characters is followed too once it's longer than a
+      // chunk (a shorter one is kept whole, text and all), unless all of it
+      // is a character cut off at the end of the window
+      if (is_invalid_run(token) && token.length >= stream->chunk_size) {
+        keep_cut_character(stream, &piece);
+      }
+      if (is_invalid_run(token) && token.length >= stream->chunk_size && piece.length > 0) {
+        whole = token;
+        whole.length = 0;
+        whole.error = ERROR_NONE;
+        whole_start = stream->window_start + token.offset;
+        STATS_PIECE(BRANCH_INVALID, token.error, token.length - piece.length, 1);
+        add_piece(stream, &whole, piece);
+        following = FOLLOW_RUN;
+        stream_fill(stream, lexer->pos);
+        continue;
+      }
+
+      // the token may carry on in the next chunk, lex it again with more
+      // input. Only it is kept, and the last byte of the whitespace before
+      // it, so a long run of whitespace isn't held and scanned again with
+      // every chunk (and is still counted as one in LEXER_STATS builds)
+      keep = token.offset > saved.pos ? token.offset - 1 : saved.pos;
+      STATS_UNCOUNT(token, stream->window, keep, saved.in_comment);
+      *lexer = saved;
+      skip_whitespace_to(stream, keep);
+      stream_fill(stream, keep);
+      continue;
+    }
+
+    if (!(lexer->options.skip_comments && token.type == TOKEN_COMMENT)) {
+      return token;
+    }
+  }
+}
+
+CompactToken stream_next_token(StreamLexer *stream) {
+  SymbolTable *symbols = stream->lexer.symbols;
+  CompactToken token;
+
+  // a token can be lexed more than once as the window grows, so it's only
+  // interned once it's final
+  stream->lexer.symbols = NULL;
+  token = next_token(stream);
+  stream->lexer.symbols = symbols;
+  if (symbols && (token.type == TOKEN_IDENTIFIER || token.type == TOKEN_STRING)) {
+    token.id = symtab_intern(symbols, stream->text, token.length);
+  }
+  return token;
+}
+
+Token stream_expand_token(const StreamLexer *stream, CompactToken compact) {
+  return token_from_text(compact, stream->text, stream->text_length);
+}
@@ -0,0 +1,102 @@
+/* symtab.c */
+#include "../../include/symtab.h"
+#include <string.h>
+
+void symtab_init(SymbolTable *table, Arena *arena) {
+  memset(table, 0, sizeof(*table));
+  table->arena = arena;
+}
+
+static uint32_t hash_text(const char *text, size_t length) {
+  uint32_t hash = 2166136261u; // FNV-1a
+  size_t i;
+
+  for (i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+  }
+  return hash;
+}
+
+/* Double the slots (or make the first ones) and put every ID back; the
+ * old slots stay in the arena, which at most doubles what they cost
+ */
+static int grow_slots(SymbolTable *table) {
+  size_t slot_count = table->slot_count ? table->slot_count * 2 : 256;
+  uint32_t *slots = arena_alloc(table->arena, slot_count * sizeof(uint32_t));
+  size_t id;
+
+  if (slots == NULL) {
+    return -1;
+  }
+  memset(slots, 0, slot_count * sizeof(uint32_t));
+  for (id = 1; id <= table->count; id++) {
+    size_t slot = table->symbols[id - 1].hash & (slot_count - 1);
+
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & (slot_count - 1);
+    }
+    slots[slot] = (uint32_t)id;
+  }
+  table->slots = slots;
+  table->slot_count = slot_count;
+  return 0;
+}
+
+uint32_t symtab_intern(SymbolTable *table, const char *text, size_t length) {
+  uint32_t hash = hash_text(text, length);
+  size_t slot;
+  Symbol *symbol;
+
+  if (table->slot_count > 0) {
+    for (slot = hash & (table->slot_count - 1); table->slots[slot] != 0;
+         slot = (slot + 1) & (table->slot_count - 1)) {
+      symbol = &table->symbols[table->slots[slot] - 1];
+      if (symbol->hash == hash && symbol->length == length && memcmp(symbol->text, text, length) == 0) {
+        return table->slots[slot];
+      }
+    }
+  }
+
+  // new symbol: keep the slots at most half full so probes stay short
+  if (table->count >= SYMBOL_MAX || length > UINT32_MAX) {
+    return 0;
+  }
+  if ((table->count + 1) * 2 > table->slot_count && grow_slots(table) != 0) {
+    return 0;
+  }
+  if (table->count == table->capacity) {
+    size_t capacity = table->capacity ? table->capacity * 2 : 256;
+    Symbol *symbols =
+        arena_grow(table->arena, table->symbols, table->count * sizeof(Symbol), capacity * sizeof(Symbol));
+
+    if (symbols == NULL) {
+      return 0;
+    }
+    table->symbols = symbols;
+    table->capacity = capacity;
+  }
+
+  symbol = &table->symbols[table->count];
+  symbol->text = arena_copy(table->arena, text, length);
+  if (symbol->text == NULL) {
+    return 0;
+  }
+  symbol->length = (uint32_t)length;
+  symbol->hash = hash;
+  table->count++;
+
+  slot = hash & (table->slot_count - 1);
+  while (table->slots[slot] != 0) {
+    slot = (slot + 1) & (table->slot_count - 1);
+  }
+  table->slots[slot] = (uint32_t)table->count;
+  return (uint32_t)table->count;
+}
+
+const char *symtab_text(const SymbolTable *table, uint32_t id, size_t *length) {
+  if (id == 0 || id > table->count) {
+    return NULL;
+  }
+  *length = table->symbols[id - 1].length;
+  return table->symbols[id - 1].text;
+}
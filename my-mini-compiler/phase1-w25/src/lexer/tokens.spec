@@ -0,0 +1,42 @@
+# tokens.spec
+# The tokens the lexer recognizes, turned into DFA tables by tools/dfagen.c
+# when the lexer is built (into dfa_tables.h, see dfa_match in lexer.c).
+#
+#   name = [class]      a named set of bytes, used as {name} in a pattern
+#   ACTION pattern      a rule; the pattern runs to the end of the line
+#   ACTION @keywords    one rule per keyword in keywords.def, ACTION_<ID>
+#
+# Patterns: literal bytes; escapes \n \r \t \0 \xHH, and \ before any other
+# byte to take it literally; [...] with ranges, ^ and {name}; {name}; . for
+# any byte; ( ) | * + ?
+#
+# The longest match wins, and between rules matching the same text the one
+# written first. lexer.c handles each ACTION and applies the length limits.
+#
+# Whitespace is skipped before the DFA runs, and the rules for comments and
+# strings only match how they open: lexer.c finds where they end with the
+# scanners in scan.h, which test 16 or 32 bytes at a time where a DFA would
+# take a step per byte. A block comment may also have opened in an earlier
+# input (see stream.h).
+
+# Ends a number, valid or not, without being part of it
+end = [ \t\r\n\0+\-*/&|%=\{\}();]
+# Whitespace, or the first byte of some token
+start = [ \t\r\n"A-Za-z0-9_+\-*/&|%=!\{\}()\[\];,]
+
+# to the end of the line
+LINE_COMMENT //
+# to the closing */, or the end of input
+BLOCK_COMMENT /\*
+KEYWORD @keywords
+IDENTIFIER [A-Za-z_][A-Za-z0-9_]*
+# '-' only starts a number when a digit follows; otherwise it's an operator
+NUMBER -?[0-9]+
+# an invalid number runs on to the next character that can end one
+BAD_NUMBER -?[0-9]+[^0-9{end}][^{end}]*
+# to the closing quote; without one, to the end of the line
+STRING "
+OPERATOR [-+*/&|%=!]
+DELIMITER [\{\}()\[\];,]
+# bytes no token can start with are one error, up to the next one that can
+INVALID [^{start}]+
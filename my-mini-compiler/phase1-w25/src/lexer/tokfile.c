@@ -0,0 +1,254 @@
+/* tokfile.c */
+#include "../../include/tokfile.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Header field offsets */
+#define HEADER_VERSION 4
+#define HEADER_TOKEN_COUNT 8
+#define HEADER_STRING_COUNT 12
+#define HEADER_STRING_OFFSETS 16
+#define HEADER_STRINGS 20
+#define HEADER_TOKENS 24
+#define HEADER_FILE_SIZE 28
+
+/* Set in a record's first byte when its length differs from its lexeme's */
+#define RECORD_HAS_LENGTH 0x80
+
+/* Longest varint a uint32 can need */
+#define MAX_VARINT 5
+
+static void put_u32(unsigned char *out, uint32_t value) {
+  out[0] = (unsigned char)value;
+  out[1] = (unsigned char)(value >> 8);
+  out[2] = (unsigned char)(value >> 16);
+  out[3] = (unsigned char)(value >> 24);
+}
+
+static uint32_t get_u32(const unsigned char *in) {
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+/* Grow *buffer so it holds at least needed elements of size bytes */
+static int reserve(void **buffer, size_t *capacity, size_t needed, size_t size) {
+  size_t grown = *capacity;
+  void *resized;
+
+  if (needed <= *capacity) {
+    return 0;
+  }
+  while (grown < needed) {
+    grown = grown ? grown * 2 : 256;
+  }
+  resized = realloc(*buffer, grown * size);
+  if (resized == NULL) {
+    return -1;
+  }
+  *buffer = resized;
+  *capacity = grown;
+  return 0;
+}
+
+int tokfile_writer_init(TokenFileWriter *writer) {
+  memset(writer, 0, sizeof(*writer));
+  arena_init(&writer->arena);
+  symtab_init(&writer->strings, &writer->arena);
+  return 0;
+}
+
+static unsigned char *put_varint(unsigned char *out, uint32_t value) {
+  while (value >= 0x80) {
+    *out++ = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = (unsigned char)value;
+  return out;
+}
+
+int tokfile_add(TokenFileWriter *writer, CompactToken token, const char *text, size_t text_length) {
+  size_t strings = writer->strings.count;
+  uint32_t id = symtab_intern(&writer->strings, text, text_length);
+  int32_t line_delta = (int32_t)(token.line - writer->last_line);
+  unsigned char *out;
+
+  if (id == 0 || reserve((void **)&writer->records, &writer->records_capacity,
+                           writer->records_length + 2 + 4 * MAX_VARINT, 1) != 0) {
+    return -1;
+  }
+
+  out = writer->records + writer->records_length;
+  *out++ = (unsigned char)(token.type | token.error << 4 | (token.length != text_length ? RECORD_HAS_LENGTH : 0));
+  if (token.type == TOKEN_KEYWORD) {
+    *out++ = (unsigned char)token.id;
+  }
+  out = put_varint(out, token.offset - writer->last_end);
+  if (token.length != text_length) {
+    out = put_varint(out, token.length);
+  }
+  out = put_varint(out, (uint32_t)line_delta << 1 ^ (uint32_t)(line_delta >> 31));
+  out = put_varint(out, id - 1);
+  writer->records_length = out - writer->records;
+
+  if (writer->strings.count > strings) {
+    writer->strings_length += text_length;
+  }
+  writer->last_end = token.offset + token.length;
+  writer->last_line = token.line;
+  writer->token_count++;
+  return 0;
+}
+
+int tokfile_write(const TokenFileWriter *writer, FILE *file) {
+  unsigned char header[TOKFILE_HEADER_SIZE] = {0};
+  unsigned char offset[4];
+  size_t string_count = writer->strings.count;
+  size_t string_offsets = TOKFILE_HEADER_SIZE;
+  size_t strings = string_offsets + (string_count + 1) * 4;
+  uint32_t at = 0;
+  size_t tokens = strings + writer->strings_length;
+  size_t i;
+
+  memcpy(header, TOKFILE_MAGIC, 4);
+  put_u32(header + HEADER_VERSION, TOKFILE_VERSION);
+  put_u32(header + HEADER_TOKEN_COUNT, (uint32_t)writer->token_count);
+  put_u32(header + HEADER_STRING_COUNT, (uint32_t)string_count);
+  put_u32(header + HEADER_STRING_OFFSETS, (uint32_t)string_offsets);
+  put_u32(header + HEADER_STRINGS, (uint32_t)strings);
+  put_u32(header + HEADER_TOKENS, (uint32_t)tokens);
+  put_u32(header + HEADER_FILE_SIZE, (uint32_t)(tokens + writer->records_length));
+
+  if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+    return -1;
+  }
+  for (i = 0; i <= string_count; i++) {
+    put_u32(offset, at);
+    if (fwrite(offset, 1, 4, file) != 4) {
+      return -1;
+    }
+    if (i < string_count) {
+      at += writer->strings.symbols[i].length;
+    }
+  }
+  for (i = 0; i < string_count; i++) {
+    const Symbol *symbol = &writer->strings.symbols[i];
+
+    if (fwrite(symbol->text, 1, symbol->length, file) != symbol->length) {
+      return -1;
+    }
+  }
+  if (fwrite(writer->records, 1, writer->records_length, file) != writer->records_length) {
+    return -1;
+  }
+  return fflush(file) == 0 ? 0 : -1;
+}
+
+void tokfile_writer_free(TokenFileWriter *writer) {
+  free(writer->records);
+  writer->records = NULL;
+  arena_free(&writer->arena);
+}
+
+int tokfile_open(TokenFile *file, const void *data, size_t size) {
+  const unsigned char *bytes = data;
+  uint32_t string_offsets, strings, tokens;
+
+  if (size < TOKFILE_HEADER_SIZE || memcmp(bytes, TOKFILE_MAGIC, 4) != 0 ||
+      get_u32(bytes + HEADER_VERSION) != TOKFILE_VERSION || get_u32(bytes + HEADER_FILE_SIZE) != size) {
+    return -1;
+  }
+
+  file->data = bytes;
+  file->size = size;
+  file->token_count = get_u32(bytes + HEADER_TOKEN_COUNT);
+  file->string_count = get_u32(bytes + HEADER_STRING_COUNT);
+  string_offsets = get_u32(bytes + HEADER_STRING_OFFSETS);
+  strings = get_u32(bytes + HEADER_STRINGS);
+  tokens = get_u32(bytes + HEADER_TOKENS);
+
+  // sections must be in order and the offsets table must fit before the strings
+  if (string_offsets < TOKFILE_HEADER_SIZE || strings < string_offsets || strings > tokens || tokens > size ||
+      (uint64_t)file->string_count + 1 > (strings - string_offsets) / 4 ||
+      get_u32(bytes + string_offsets + file->string_count * 4) > tokens - strings) {
+    return -1;
+  }
+
+  file->string_offsets = bytes + string_offsets;
+  file->strings = (const char *)bytes + strings;
+  file->tokens = bytes + tokens;
+  return 0;
+}
+
+void tokfile_cursor_init(TokenFileCursor *cursor, const TokenFile *file) {
+  cursor->file = file;
+  cursor->pos = file->tokens;
+  cursor->remaining = file->token_count;
+  cursor->last_end = 0;
+  cursor->last_line = 0;
+}
+
+/* Read a varint that must end before end; returns NULL if it doesn't */
+static const unsigned char *get_varint(const unsigned char *in, const unsigned char *end, uint32_t *value) {
+  uint32_t result = 0;
+  int shift;
+
+  for (shift = 0; shift < 7 * MAX_VARINT && in < end; shift += 7) {
+    unsigned char byte = *in++;
+
+    result |= (uint32_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return in;
+    }
+  }
+  return NULL;
+}
+
+int tokfile_next(TokenFileCursor *cursor, CompactToken *token, const char **text, size_t *text_length) {
+  const TokenFile *file = cursor->file;
+  const unsigned char *end = file->data + file->size;
+  const unsigned char *in = cursor->pos;
+  uint32_t gap, length = 0, line, index, start, stop;
+  int has_length;
+
+  if (cursor->remaining == 0) {
+    return 0;
+  }
+  if (in >= end) {
+    return -1;
+  }
+
+  token->type = *in & 0x0f;
+  token->error = (*in >> 4) & 0x07;
+  has_length = *in++ & RECORD_HAS_LENGTH;
+  token->id = 0;
+  if (token->type == TOKEN_KEYWORD) {
+    if (in >= end) {
+      return -1;
+    }
+    token->id = *in++;
+  }
+
+  if ((in = get_varint(in, end, &gap)) == NULL || (has_length && (in = get_varint(in, end, &length)) == NULL) ||
+      (in = get_varint(in, end, &line)) == NULL || (in = get_varint(in, end, &index)) == NULL ||
+      index >= file->string_count) {
+    return -1;
+  }
+
+  start = get_u32(file->string_offsets + index * 4);
+  stop = get_u32(file->string_offsets + index * 4 + 4);
+  if (start > stop || stop > (uint32_t)(file->tokens - (const unsigned char *)file->strings)) {
+    return -1;
+  }
+  *text = file->strings + start;
+  *text_length = stop - start;
+
+  token->offset = cursor->last_end + gap;
+  token->length = has_length ? length : stop - start;
+  token->line = cursor->last_line + ((line >> 1) ^ (0u - (line & 1)));
+
+  cursor->pos = in;
+  cursor->remaining--;
+  cursor->last_end = token->offset + token->length;
+  cursor->last_line = token->line;
+  return 1;
+}
@@ -0,0 +1,132 @@
+/* utf8.h */
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Decoding for the lexer's UTF-8 mode (LexerOptions.utf8) */
+
+/* Length of the well-formed UTF-8 sequence at pos (1 to 4 bytes), storing
+ * its code point, or 0 if there isn't one: a stray continuation byte, a
+ * sequence cut short by end, an overlong encoding, a surrogate or a value
+ * past U+10FFFF
+ */
+static inline size_t utf8_decode(const char *input, size_t pos, size_t end, uint32_t *code_point) {
+  const unsigned char *s = (const unsigned char *)input + pos;
+  size_t left = end - pos;
+  uint32_t c = s[0];
+
+  if (c < 0x80) {
+    *code_point = c;
+    return 1;
+  }
+  if (c < 0xC2) {
+    // a continuation byte, or the start of an overlong two byte sequence
+    return 0;
+  }
+  if (c < 0xE0) {
+    if (left < 2 || (s[1] & 0xC0) != 0x80) {
+      return 0;
+    }
+    *code_point = (c & 0x1F) << 6 | (s[1] & 0x3F);
+    return 2;
+  }
+  if (c < 0xF0) {
+    if (left < 3 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80) {
+      return 0;
+    }
+    c = (c & 0x0F) << 12 | (uint32_t)(s[1] & 0x3F) << 6 | (s[2] & 0x3F);
+    if (c < 0x800 || (c >= 0xD800 && c <= 0xDFFF)) {
+      return 0;
+    }
+    *code_point = c;
+    return 3;
+  }
+  if (c < 0xF5) {
+    if (left < 4 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 || (s[3] & 0xC0) != 0x80) {
+      return 0;
+    }
+    c = (c & 0x07) << 18 | (uint32_t)(s[1] & 0x3F) << 12 | (uint32_t)(s[2] & 0x3F) << 6 | (s[3] & 0x3F);
+    if (c < 0x10000 || c > 0x10FFFF) {
+      return 0;
+    }
+    *code_point = c;
+    return 4;
+  }
+  return 0;
+}
+
+/* Number of bytes at the end of [start, end) that begin a sequence end cuts
+ * off, which more input could still complete (0 if there are none)
+ */
+static inline size_t utf8_cut_tail(const char *input, size_t start, size_t end) {
+  size_t back;
+
+  for (back = 1; back <= 3 && back <= end - start; back++) {
+    unsigned char c = (unsigned char)input[end - back];
+
+    if ((c & 0xC0) != 0x80) {
+      // the lead byte: how long its sequence should be
+      size_t need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+
+      return need > back ? back : 0;
+    }
+  }
+  return 0;
+}
+
+/* A range of code points, first to last inclusive */
+typedef struct {
+  uint32_t first;
+  uint32_t last;
+} CodeRange;
+
+/* Characters C11 allows in identifiers (Annex D.1) */
+static const CodeRange c11_identifier[] = {
+    {0x00A8, 0x00A8},   {0x00AA, 0x00AA},   {0x00AD, 0x00AD},   {0x00AF, 0x00AF},   {0x00B2, 0x00B5},
+    {0x00B7, 0x00BA},   {0x00BC, 0x00BE},   {0x00C0, 0x00D6},   {0x00D8, 0x00F6},   {0x00F8, 0x00FF},
+    {0x0100, 0x167F},   {0x1681, 0x180D},   {0x180F, 0x1FFF},   {0x200B, 0x200D},   {0x202A, 0x202E},
+    {0x203F, 0x2040},   {0x2054, 0x2054},   {0x2060, 0x206F},   {0x2070, 0x218F},   {0x2460, 0x24FF},
+    {0x2776, 0x2793},   {0x2C00, 0x2DFF},   {0x2E80, 0x2FFF},   {0x3004, 0x3007},   {0x3021, 0x302F},
+    {0x3031, 0x303F},   {0x3040, 0xD7FF},   {0xF900, 0xFD3D},   {0xFD40, 0xFDCF},   {0xFDF0, 0xFE44},
+    {0xFE47, 0xFFFD},   {0x10000, 0x1FFFD}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}, {0x40000, 0x4FFFD},
+    {0x50000, 0x5FFFD}, {0x60000, 0x6FFFD}, {0x70000, 0x7FFFD}, {0x80000, 0x8FFFD}, {0x90000, 0x9FFFD},
+    {0xA0000, 0xAFFFD}, {0xB0000, 0xBFFFD}, {0xC0000, 0xCFFFD}, {0xD0000, 0xDFFFD}, {0xE0000, 0xEFFFD},
+};
+
+/* Of those, the combining marks that can't start one (Annex D.2) */
+static const CodeRange c11_not_first[] = {
+    {0x0300, 0x036F}, {0x1DC0, 0x1DFF}, {0x20D0, 0x20FF}, {0xFE20, 0xFE2F},
+};
+
+/* Is code_point in one of the count sorted ranges? */
+static inline int in_ranges(uint32_t code_point, const CodeRange *ranges, size_t count) {
+  size_t low = 0;
+  size_t high = count;
+
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+
+    if (code_point > ranges[mid].last) {
+      low = mid + 1;
+    } else if (code_point < ranges[mid].first) {
+      high = mid;
+    } else {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#define RANGE_COUNT(ranges) (sizeof(ranges) / sizeof(ranges[0]))
+
+/* Can the non-ASCII code_point be in a C11 identifier (first: start one)? */
+static inline int c11_identifier_char(uint32_t code_point, int first) {
+  if (!in_ranges(code_point, c11_identifier, RANGE_COUNT(c11_identifier))) {
+    return 0;
+  }
+  return !first || !in_ranges(code_point, c11_not_first, RANGE_COUNT(c11_not_first));
+}
+
+#endif /* UTF8_H */
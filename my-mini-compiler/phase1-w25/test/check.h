@@ -0,0 +1,113 @@
+/* check.h
+ * Shared by the tests: a CHECK that reports and counts failures, the tokens
+ * one lexer gives straight through to check others against, and a
+ * generator of random source and options full of the cases the lexer finds
+ * hardest (comments, strings, invalid bytes and UTF-8, long runs, line
+ * endings, tiny length limits).
+ */
+#ifndef CHECK_H
+#define CHECK_H
+
+#include "../include/lexer.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures;
+
+/* Report cond failing, with a printf-style note, and keep going */
+#define CHECK(cond, ...)                                                                                               \
+  do {                                                                                                                 \
+    if (!(cond)) {                                                                                                     \
+      if (failures++ < 10) {                                                                                           \
+        printf("%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond);                                              \
+        printf(__VA_ARGS__);                                                                                           \
+        printf("\n");                                                                                                  \
+      }                                                                                                                \
+    }                                                                                                                  \
+  } while (0)
+
+/* What a test returns from main */
+#define CHECK_RESULT() (failures > 0 ? (printf("%d checks failed\n", failures), 1) : 0)
+
+static inline int same_token(CompactToken a, CompactToken b) {
+  return a.offset == b.offset && a.length == b.length && a.line == b.line && a.type == b.type &&
+         a.error == b.error && a.id == b.id;
+}
+
+/* xorshift, so a seed always gives the same input */
+static inline unsigned int next_random(unsigned int *state) {
+  unsigned int x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/* Fill buffer with size bytes of random source */
+static inline void random_source(char *buffer, size_t size, unsigned int seed) {
+  static const char *const pieces[] = {
+      "int",     "x",        "while",    "counter_1", "123",      "1a2",       "99999999", "-7",     "+",
+      "-",       "*",        "/",        "=",         "==",       "&&",        "||",       "!",      "++",
+      "(",       ")",        "{",        "}",         ";",        ",",         "\"str\"",  "\"un",   "\"a b\"",
+      "// c\n",  "//",       "/* c */",  "/*",        "*/",       "/* a\nb */", "/**/",    "@",      "#$",
+      "\x80",    "\xff\xfe", "\xc3\xa9", "caf\xc3\xa9", "\xe2\x82", "\r\n",      "\n",       "\n\n",   "\t",
+  };
+  static const size_t count = sizeof(pieces) / sizeof(pieces[0]);
+  unsigned int state = seed ? seed : 1;
+  size_t pos = 0;
+
+  while (pos < size) {
+    unsigned int r = next_random(&state);
+    const char *piece = pieces[r % count];
+    size_t length = strlen(piece);
+
+    if (length > size - pos) {
+      length = size - pos;
+    }
+    memcpy(buffer + pos, piece, length);
+    pos += length;
+
+    // mostly separated by a space, sometimes run together
+    if (pos < size && (r >> 8) % 4 != 0) {
+      buffer[pos++] = ' ';
+    }
+  }
+}
+
+/* Options for a seed: comments skipped or not, UTF-8 or not, and now and
+ * then length limits from none to a few bytes
+ */
+static inline LexerOptions seed_options(unsigned int seed) {
+  LexerOptions options = lexer_default_options();
+
+  options.skip_comments = seed % 2;
+  options.utf8 = seed % 3 == 0;
+  if (seed % 4 == 0) {
+    lexer_set_limits(&options, seed % 8);
+  }
+  return options;
+}
+
+/* Every token lexer has left, EOF included, written to out; returns how
+ * many there were
+ */
+static inline size_t lex_rest(Lexer *lexer, CompactToken *out) {
+  size_t count = 0;
+
+  do {
+    count += lex_batch(lexer, out + count, 64);
+  } while (out[count - 1].type != TOKEN_EOF);
+  return count;
+}
+
+/* All the tokens of length bytes of input, as lex_batch gives them */
+static inline size_t lex_all(const char *input, size_t length, const LexerOptions *options, CompactToken *out) {
+  Lexer lexer;
+
+  lexer_init(&lexer, input, length);
+  lexer.options = *options;
+  return lex_rest(&lexer, out);
+}
+
+#endif /* CHECK_H */
@@ -0,0 +1,117 @@
+/* cursor_test.c
+ * A TokenCursor against lex_batch on the same input: every peek distance at
+ * every position (so peeks span the ring wrapping around), then random
+ * next/peek/mark/reset sequences, including resets to marks that have left
+ * the ring, which must lex again without repeating diagnostics.
+ */
+#include "../include/cursor.h"
+#include "../include/diag.h"
+#include "check.h"
+#include <stdlib.h>
+
+#define INPUT_SIZE 4096
+#define MAX_TOKENS (INPUT_SIZE + 1)
+#define SEEDS 40
+
+static char input[INPUT_SIZE];
+static CompactToken expected[MAX_TOKENS];
+
+/* Token index of the expected sequence, EOF once past its end */
+static CompactToken expected_at(size_t index, size_t count) {
+  return expected[index < count ? index : count - 1];
+}
+
+static void check_peeks(const LexerOptions *options, unsigned int seed) {
+  size_t count = lex_all(input, INPUT_SIZE, options, expected);
+  Lexer lexer;
+  TokenCursor cursor;
+  size_t i;
+  size_t k;
+
+  lexer_init(&lexer, input, INPUT_SIZE);
+  lexer.options = *options;
+  cursor_init(&cursor, &lexer);
+
+  for (i = 0; i <= count; i++) {
+    // past the ring, peek gives the furthest token it can
+    for (k = 0; k <= CURSOR_LOOKAHEAD; k++) {
+      size_t reach = k < CURSOR_LOOKAHEAD ? k : CURSOR_LOOKAHEAD - 1;
+
+      CHECK(same_token(cursor_peek(&cursor, k), expected_at(i + reach, count)), "seed %u token %zu peek %zu", seed,
+            i, k);
+    }
+    CHECK(same_token(cursor_next(&cursor), expected_at(i, count)), "seed %u next %zu", seed, i);
+  }
+}
+
+static void check_backtracking(const LexerOptions *options, size_t max_errors, unsigned int seed) {
+  size_t count;
+  Arena arena;
+  Diagnostics once;
+  Diagnostics replayed;
+  Lexer lexer;
+  TokenCursor cursor;
+  CursorMark marks[8];
+  size_t marked = 0;
+  size_t index = 0;
+  unsigned int state = seed;
+  int step;
+
+  // the expected tokens, and diagnostics, from lexing straight through
+  arena_init(&arena);
+  diag_init(&once, &arena, max_errors);
+  diag_init(&replayed, &arena, max_errors);
+  lexer_init(&lexer, input, INPUT_SIZE);
+  lexer.options = *options;
+  lexer.diagnostics = &once;
+  count = lex_rest(&lexer, expected);
+
+  lexer_init(&lexer, input, INPUT_SIZE);
+  lexer.options = *options;
+  lexer.diagnostics = &replayed;
+  cursor_init(&cursor, &lexer);
+
+  for (step = 0; step < 5000; step++) {
+    unsigned int r = next_random(&state) % 16;
+
+    if (r < 8) {
+      CHECK(same_token(cursor_next(&cursor), expected_at(index, count)), "seed %u step %d next %zu", seed, step,
+            index);
+      index++;
+    } else if (r < 12) {
+      size_t k = next_random(&state) % CURSOR_LOOKAHEAD;
+
+      CHECK(same_token(cursor_peek(&cursor, k), expected_at(index + k, count)), "seed %u step %d peek %zu", seed,
+            step, index + k);
+    } else if (r < 14) {
+      marks[marked < 8 ? marked++ : next_random(&state) % 8] = cursor_mark(&cursor);
+    } else if (marked > 0) {
+      const CursorMark *mark = &marks[next_random(&state) % marked];
+
+      cursor_reset(&cursor, mark);
+      index = mark->index;
+    }
+  }
+  while (cursor_next(&cursor).type != TOKEN_EOF) {
+  }
+
+  CHECK(once.count == replayed.count, "seed %u: %zu diagnostics, %zu after resets", seed, once.count,
+        replayed.count);
+  CHECK(once.count != replayed.count || once.count == 0 ||
+            memcmp(once.items, replayed.items, once.count * sizeof(Diagnostic)) == 0,
+        "seed %u: diagnostics differ after resets", seed);
+  arena_free(&arena);
+}
+
+int main(void) {
+  LexerOptions options;
+  unsigned int seed;
+
+  for (seed = 1; seed <= SEEDS; seed++) {
+    options = seed_options(seed);
+    random_source(input, INPUT_SIZE, seed);
+    check_peeks(&options, seed);
+    check_backtracking(&options, seed % 4 == 0 ? 20 : 0, seed);
+  }
+  return CHECK_RESULT();
+}
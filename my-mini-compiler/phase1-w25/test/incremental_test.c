@@ -0,0 +1,114 @@
+/* incremental_test.c
+ * Random edits to an IncrementalLexer, checked after every one against a
+ * copy of the text edited by hand and lexed from scratch. The edits insert
+ * and delete the pieces that change the most tokens (comment and string
+ * delimiters, newlines) and cut through tokens, and the TokenChange each
+ * returns must account for every token that moved.
+ */
+#include "../include/incremental.h"
+#include "check.h"
+#include <stdlib.h>
+
+#define START_SIZE 2048
+#define MAX_SIZE 8192
+#define SEEDS 20
+#define EDITS 300
+
+static char text[MAX_SIZE];
+static CompactToken before[MAX_SIZE + 1];
+static CompactToken expected[MAX_SIZE + 1];
+
+static int count_newlines(const char *from, size_t length) {
+  int newlines = 0;
+  size_t i;
+
+  for (i = 0; i < length; i++) {
+    newlines += from[i] == '\n';
+  }
+  return newlines;
+}
+
+static void run(unsigned int seed) {
+  LexerOptions options = lexer_default_options();
+  static const char *const inserts[] = {"/*", "*/", "\"", "//", "\n", "*", "/", "x", "12", " ", "+", "@", "int y;\n"};
+  IncrementalLexer document;
+  unsigned int state = seed;
+  size_t length = START_SIZE;
+  int edit;
+
+  random_source(text, length, seed);
+  if (incremental_init(&document, text, length) != 0) {
+    CHECK(0, "seed %u: out of memory", seed);
+    return;
+  }
+
+  for (edit = 0; edit < EDITS; edit++) {
+    const char *inserted = inserts[next_random(&state) % (sizeof(inserts) / sizeof(inserts[0]))];
+    size_t inserted_length = strlen(inserted);
+    size_t offset = next_random(&state) % (length + 1);
+    size_t deleted = next_random(&state) % 4 == 0 ? next_random(&state) % 16 : 0;
+    size_t old_count = document.count;
+    size_t count;
+    size_t i;
+    long shift;
+    int line_shift;
+    TokenChange change;
+
+    if (deleted > length - offset) {
+      deleted = length - offset;
+    }
+    if (length - deleted + inserted_length > MAX_SIZE) {
+      inserted_length = 0;
+    }
+    for (i = 0; i < old_count; i++) {
+      before[i] = incremental_token(&document, i);
+    }
+    line_shift = count_newlines(inserted, inserted_length) - count_newlines(text + offset, deleted);
+
+    CHECK(incremental_edit(&document, offset, deleted, inserted, inserted_length, &change) == 0,
+          "seed %u edit %d failed", seed, edit);
+    memmove(text + offset + inserted_length, text + offset + deleted, length - offset - deleted);
+    memcpy(text + offset, inserted, inserted_length);
+    length = length - deleted + inserted_length;
+    shift = (long)inserted_length - (long)deleted;
+
+    CHECK(document.length == length && memcmp(incremental_text(&document), text, length) == 0,
+          "seed %u edit %d: text differs", seed, edit);
+    count = lex_all(text, length, &options, expected);
+    CHECK(document.count == count, "seed %u edit %d: %zu tokens, expected %zu", seed, edit, document.count, count);
+    for (i = 0; i < count && i < document.count; i++) {
+      if (!same_token(incremental_token(&document, i), expected[i])) {
+        CHECK(0, "seed %u edit %d: token %zu at %u differs", seed, edit, i, expected[i].offset);
+        break;
+      }
+    }
+
+    // outside the change, tokens are the old ones shifted past the edit
+    CHECK(change.first + change.removed <= old_count && change.first + change.inserted <= document.count &&
+              old_count - change.removed == document.count - change.inserted,
+          "seed %u edit %d: change doesn't add up", seed, edit);
+    for (i = 0; i < change.first && i < count; i++) {
+      CHECK(same_token(before[i], expected[i]), "seed %u edit %d: token %zu before the change moved", seed, edit, i);
+    }
+    for (i = change.first + change.inserted; i < count && i - change.inserted + change.removed < old_count; i++) {
+      CompactToken old = before[i - change.inserted + change.removed];
+
+      old.offset = (uint32_t)(old.offset + shift);
+      old.line = (uint32_t)((int)old.line + line_shift);
+      if (!same_token(old, expected[i])) {
+        CHECK(0, "seed %u edit %d: token %zu after the change isn't the old one shifted", seed, edit, i);
+        break;
+      }
+    }
+  }
+  incremental_free(&document);
+}
+
+int main(void) {
+  unsigned int seed;
+
+  for (seed = 1; seed <= SEEDS; seed++) {
+    run(seed);
+  }
+  return CHECK_RESULT();
+}
@@ -0,0 +1,162 @@
+/* location_test.c
+ * Lines and columns against a count made by hand: every ScanOps variant's
+ * find_newlines, line_index_start and line_index_locate at every offset,
+ * and the line of every token, expand_token's columns and lexer_locate as
+ * the lexer goes, with and without a line index (Lexer.lines).
+ */
+#include "../include/lexer.h"
+#include "../include/lineindex.h"
+#include "../src/lexer/scan.h"
+#include "check.h"
+
+#define INPUT_SIZE 4096
+#define SEEDS 20
+
+static char input[INPUT_SIZE];
+static SourceLocation expected[INPUT_SIZE + 1]; // Where each offset is
+static uint32_t starts[INPUT_SIZE];             // Offset just past each '\n'
+static size_t newlines;
+static uint32_t found[INPUT_SIZE];
+
+static int same_location(SourceLocation a, SourceLocation b) {
+  return a.line == b.line && a.column == b.column;
+}
+
+/* Fill expected and starts a byte at a time */
+static void count_lines(void) {
+  size_t start = 0;
+  size_t i;
+
+  newlines = 0;
+  for (i = 0; i <= INPUT_SIZE; i++) {
+    expected[i].line = (int)newlines + 1;
+    expected[i].column = (int)(i - start) + 1;
+    if (i < INPUT_SIZE && input[i] == '\n') {
+      start = i + 1;
+      starts[newlines++] = (uint32_t)start;
+    }
+  }
+}
+
+/* find_newlines over the whole input, and over ranges that start and end
+ * anywhere in a vector block
+ */
+static void check_newlines(const ScanOps *scan, unsigned int seed) {
+  unsigned int state = seed;
+  size_t count = scan->find_newlines(input, 0, INPUT_SIZE, found);
+  int range;
+
+  CHECK(count == newlines && memcmp(found, starts, count * sizeof(uint32_t)) == 0,
+        "seed %u, %s: newlines differ", seed, scan->name);
+
+  for (range = 0; range < 200; range++) {
+    size_t pos = next_random(&state) % INPUT_SIZE;
+    size_t end = pos + next_random(&state) % (INPUT_SIZE - pos + 1);
+    size_t first = 0;
+    size_t last;
+
+    while (first < newlines && starts[first] <= pos) {
+      first++;
+    }
+    last = first;
+    while (last < newlines && starts[last] <= end) {
+      last++;
+    }
+    count = scan->find_newlines(input, pos, end, found);
+    CHECK(count == last - first && memcmp(found, starts + first, count * sizeof(uint32_t)) == 0,
+          "seed %u, %s: newlines from %zu to %zu differ", seed, scan->name, pos, end);
+  }
+}
+
+static void check_index(const LineIndex *index, unsigned int seed) {
+  size_t i;
+  int line;
+
+  for (i = 0; i <= INPUT_SIZE; i++) {
+    if (!same_location(line_index_locate(index, i), expected[i])) {
+      CHECK(0, "seed %u: line_index_locate(%zu) differs", seed, i);
+      break;
+    }
+  }
+  CHECK(line_index_start(index, 1) == 0, "seed %u: line 1 doesn't start at 0", seed);
+  for (line = 2; line <= (int)newlines + 1; line++) {
+    CHECK(line_index_start(index, line) == starts[line - 2], "seed %u: line %d starts elsewhere", seed, line);
+  }
+  CHECK(line_index_start(index, (int)newlines + 2) == LINE_INDEX_NONE, "seed %u: a line past the end", seed);
+  CHECK(line_index_start(index, 0) == LINE_INDEX_NONE && line_index_start(index, -1) == LINE_INDEX_NONE,
+        "seed %u: a line before the first", seed);
+}
+
+/* Every token's line and columns, offsets behind the lexer as it goes, then
+ * every offset once it's at the end
+ */
+static void check_lexer(const ScanOps *scan, LineIndex *index, const LexerOptions *options, unsigned int seed) {
+  const char *what = index != NULL ? "with an index" : "without one";
+  unsigned int state = seed;
+  CompactToken compact;
+  Lexer lexer;
+  size_t i;
+
+  lexer_init(&lexer, input, INPUT_SIZE);
+  lexer.scan = scan;
+  lexer.lines = index;
+  lexer.options = *options;
+  do {
+    size_t end;
+    size_t behind;
+    Token token;
+
+    compact = get_next_compact_token(&lexer);
+    end = (size_t)compact.offset + compact.length;
+    token = expand_token(&lexer, compact);
+    if ((int)compact.line != expected[compact.offset].line || token.column != expected[compact.offset].column ||
+        token.end_line != expected[end].line || token.end_column != expected[end].column) {
+      CHECK(0, "seed %u, %s, %s: token at %u is placed wrong", seed, scan->name, what, compact.offset);
+      break;
+    }
+    behind = next_random(&state) % (lexer.pos + 1);
+    CHECK(same_location(lexer_locate(&lexer, behind), expected[behind]), "seed %u, %s, %s: lexer_locate(%zu) at %zu",
+          seed, scan->name, what, behind, lexer.pos);
+  } while (compact.type != TOKEN_EOF);
+
+  for (i = 0; i <= INPUT_SIZE; i++) {
+    if (!same_location(lexer_locate(&lexer, i), expected[i])) {
+      CHECK(0, "seed %u, %s, %s: lexer_locate(%zu) at the end differs", seed, scan->name, what, i);
+      break;
+    }
+  }
+}
+
+int main(void) {
+  const ScanOps *variants[SCAN_OPS_COUNT];
+  size_t variant_count = scan_ops_supported(variants);
+  Arena arena;
+  LineIndex index;
+  unsigned int seed;
+  size_t v;
+
+  // an index of nothing has line 1 only
+  arena_init(&arena);
+  line_index_init(&index, &arena);
+  CHECK(line_index_start(&index, 1) == 0 && line_index_start(&index, 2) == LINE_INDEX_NONE,
+        "an empty index has lines past the first");
+
+  for (seed = 1; seed <= SEEDS; seed++) {
+    LexerOptions options = seed_options(seed);
+
+    random_source(input, INPUT_SIZE, seed);
+    count_lines();
+    CHECK(line_index_build(&index, input, INPUT_SIZE) == 0, "seed %u: out of memory", seed);
+    check_index(&index, seed);
+
+    for (v = 0; v < variant_count; v++) {
+      check_newlines(variants[v], seed);
+      check_lexer(variants[v], NULL, &options, seed);
+      check_lexer(variants[v], &index, &options, seed);
+    }
+    arena_reset(&arena);
+    line_index_init(&index, &arena);
+  }
+  arena_free(&arena);
+  return CHECK_RESULT();
+}
@@ -0,0 +1,91 @@
+/* parallel_test.c
+ * lex_parallel against one sequential lexer on the same input. The test is
+ * built with a tiny PARALLEL_MIN_SEGMENT, so even these small inputs are
+ * cut into many segments, and the inputs are made so that cuts land inside
+ * block comments, after unterminated strings and next to runs of invalid
+ * bytes, where a segment's guessed starting state is wrong.
+ */
+#include "../include/parallel.h"
+#include "check.h"
+#include <stdlib.h>
+
+#define INPUT_SIZE 8192
+#define SEEDS 30
+
+static char input[INPUT_SIZE];
+static CompactToken expected[INPUT_SIZE + 1];
+
+static void check_parallel(size_t length, const LexerOptions *options, const char *what) {
+  size_t expected_count = lex_all(input, length, options, expected);
+  CompactToken *tokens;
+  size_t count;
+  size_t i;
+  int jobs;
+
+  for (jobs = 2; jobs <= 9; jobs++) {
+    tokens = lex_parallel(input, length, *options, jobs, &count);
+    CHECK(tokens != NULL, "%s: out of memory", what);
+    if (tokens == NULL) {
+      continue;
+    }
+    CHECK(count == expected_count, "%s, %d jobs: %zu tokens, expected %zu", what, jobs, count, expected_count);
+    for (i = 0; i < count && i < expected_count; i++) {
+      if (!same_token(tokens[i], expected[i])) {
+        CHECK(0, "%s, %d jobs: token %zu at %u differs", what, jobs, i, expected[i].offset);
+        break;
+      }
+    }
+    free(tokens);
+  }
+}
+
+/* Fill input with copies of text, a newline between each */
+static size_t repeat(const char *text) {
+  size_t length = strlen(text);
+  size_t pos = 0;
+
+  while (pos + length + 1 <= INPUT_SIZE) {
+    memcpy(input + pos, text, length);
+    pos += length;
+    input[pos++] = '\n';
+  }
+  return pos;
+}
+
+static void check_options(const LexerOptions *options) {
+  // one block comment over every cut, and unterminated at the end
+  size_t length = repeat("a /* x = 1;");
+
+  input[0] = '/';
+  input[1] = '*';
+  check_parallel(length, options, "open comment");
+
+  // cuts right after an unterminated string, or an operator, or invalid
+  // bytes, so the state a segment guesses is wrong
+  check_parallel(repeat("x = \"never closed"), options, "unterminated strings");
+  check_parallel(repeat("y = - "), options, "operator before the cut");
+  check_parallel(repeat("@#\x80\xff"), options, "invalid runs");
+  check_parallel(repeat("z /* \xe2\x82"), options, "comments opened on every line");
+}
+
+int main(void) {
+  LexerOptions options = lexer_default_options();
+  unsigned int seed;
+  char what[32];
+
+  check_options(&options);
+  options.skip_comments = 1;
+  check_options(&options);
+  options.utf8 = 1;
+  check_options(&options);
+  lexer_set_limits(&options, 3);
+  check_options(&options);
+
+  for (seed = 1; seed <= SEEDS; seed++) {
+    options = seed_options(seed);
+    random_source(input, INPUT_SIZE, seed);
+    sprintf(what, "seed %u", seed);
+    check_parallel(INPUT_SIZE, &options, what);
+  }
+  return CHECK_RESULT();
+}
@@ -0,0 +1,154 @@
+/* stream_test.c
+ * A StreamLexer against one lexer over the whole input, reading chunks of
+ * every size from 1 byte up, so chunk boundaries fall inside every kind of
+ * token and comment, and that the window stays a few chunks long over
+ * whitespace and invalid characters that go on for many chunks. The test is
+ * built with a small STREAM_MAX_LENGTH to check that a stream longer than
+ * that stops there, with too_long set.
+ */
+#include "../include/stream.h"
+#include "check.h"
+
+#define INPUT_SIZE 2048
+#define MAX_CHUNK 40
+#define SEEDS 12
+#define LONG_SIZE (STREAM_MAX_LENGTH + 5000)
+#define RUN_SIZE 60000
+
+static char input[LONG_SIZE];
+static CompactToken expected[LONG_SIZE + 1];
+static size_t window_capacity; // Of the last stream checked
+
+typedef struct {
+  const char *data;
+  size_t length;
+  size_t pos;
+} MemoryReader;
+
+static size_t read_memory(void *context, char *buffer, size_t size) {
+  MemoryReader *reader = context;
+
+  if (size > reader->length - reader->pos) {
+    size = reader->length - reader->pos;
+  }
+  memcpy(buffer, reader->data + reader->pos, size);
+  reader->pos += size;
+  return size;
+}
+
+/* Stream length bytes of input in chunks of chunk_size; returns too_long */
+static int check_stream(size_t length, size_t lexed, const LexerOptions *options, size_t chunk_size,
+                        const char *what) {
+  size_t count = lex_all(input, lexed, options, expected);
+  MemoryReader reader = {input, length, 0};
+  StreamLexer stream;
+  CompactToken token;
+  size_t i = 0;
+  int too_long;
+
+  if (stream_lexer_init(&stream, read_memory, &reader, chunk_size) != 0) {
+    CHECK(0, "%s: out of memory", what);
+    return 0;
+  }
+  stream.lexer.options = *options;
+  do {
+    token = stream_next_token(&stream);
+    if (i >= count || !same_token(token, expected[i])) {
+      CHECK(0, "%s, chunks of %zu: token %zu differs", what, chunk_size, i);
+      break;
+    }
+
+    // a block comment or invalid run that outgrew the window keeps only its start
+    CHECK((stream.text_length == token.length ||
+           (stream.text_length == MAX_LEXEME_SIZE - 1 && token.length > stream.text_length &&
+            ((token.type == TOKEN_COMMENT && input[token.offset + 1] == '*') ||
+             (token.type == TOKEN_ERROR && token.error == ERROR_INVALID_CHAR)))) &&
+              memcmp(stream.text, input + token.offset, stream.text_length) == 0,
+          "%s, chunks of %zu: text of token %zu differs", what, chunk_size, i);
+    i++;
+  } while (token.type != TOKEN_EOF);
+  CHECK(!stream.failed, "%s: out of memory", what);
+  too_long = stream.too_long;
+  window_capacity = stream.capacity;
+  stream_lexer_free(&stream);
+  return too_long;
+}
+
+/* Fill input with copies of text */
+static void repeat(const char *text) {
+  size_t length = strlen(text);
+  size_t pos;
+
+  for (pos = 0; pos < INPUT_SIZE; pos++) {
+    input[pos] = text[pos % length];
+  }
+}
+
+static void check_chunks(const LexerOptions *options, const char *what) {
+  size_t chunk_size;
+
+  for (chunk_size = 1; chunk_size <= MAX_CHUNK; chunk_size++) {
+    CHECK(!check_stream(INPUT_SIZE, INPUT_SIZE, options, chunk_size, what), "%s: too long", what);
+  }
+}
+
+/* A run of text many chunks long, between a few tokens, doesn't grow the
+ * window
+ */
+static void check_run(const char *text, const LexerOptions *options, const char *what) {
+  size_t length = strlen(text);
+  size_t pos;
+
+  memcpy(input, "a = 1;", 6);
+  for (pos = 6; pos < 6 + RUN_SIZE; pos++) {
+    input[pos] = text[pos % length];
+  }
+  memcpy(input + pos, "b = 2;\n", 7);
+  pos += 7;
+
+  CHECK(!check_stream(pos, pos, options, 64, what), "%s: too long", what);
+  CHECK(window_capacity <= 4 * 64, "%s: the window grew to %zu bytes", what, window_capacity);
+}
+
+static void check_options(const LexerOptions *options) {
+  // comments longer than any chunk, some left open, some closed by a '*'
+  // and '/' that end up in different chunks
+  repeat("/* a long comment that runs on \xc3\xa9 and on */ x /**/ y /*** z **/\n");
+  check_chunks(options, "long comments");
+  repeat("id_that_is_rather_long = 12345 + \"a string that is long\" // note \xe2\x82\xac\n");
+  check_chunks(options, "long tokens");
+  repeat("a /* never closed");
+  check_chunks(options, "open comment");
+
+  check_run(" \t\n  \r\n", options, "long whitespace");
+  check_run("@$\x80\xff", options, "long invalid run");
+}
+
+int main(void) {
+  LexerOptions options = lexer_default_options();
+  unsigned int seed;
+  char what[32];
+
+  check_options(&options);
+  options.skip_comments = 1;
+  check_options(&options);
+  options.utf8 = 1;
+  check_options(&options);
+  lexer_set_limits(&options, 5);
+  check_options(&options);
+
+  for (seed = 1; seed <= SEEDS; seed++) {
+    options = seed_options(seed);
+    random_source(input, INPUT_SIZE, seed);
+    sprintf(what, "seed %u", seed);
+    check_chunks(&options, what);
+  }
+
+  // past STREAM_MAX_LENGTH, the stream ends as if the input did
+  options = lexer_default_options();
+  random_source(input, LONG_SIZE, 1);
+  CHECK(check_stream(LONG_SIZE, STREAM_MAX_LENGTH, &options, 1000, "too long"), "too_long isn't set");
+  CHECK(!check_stream(STREAM_MAX_LENGTH, STREAM_MAX_LENGTH, &options, 1000, "just short enough"),
+        "too_long is set");
+  return CHECK_RESULT();
+}
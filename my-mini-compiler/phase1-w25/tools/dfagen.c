@@ -0,0 +1,673 @@
+/* dfagen.c
+ * Builds the lexer's DFA tables from the token spec, run by the build.
+ *
+ * usage: dfagen tokens.spec dfa_tables.h
+ *
+ * Every rule's pattern becomes an NFA (Thompson's construction), the rules
+ * are joined under one start state and the subset construction turns that
+ * into a DFA over classes of bytes that behave alike. A DFA state accepts
+ * for the earliest rule among the NFA states it holds, so the order of the
+ * spec settles ties between rules that match the same text; the lexer picks
+ * the longest match. See tokens.spec for the pattern syntax.
+ */
+#include "../include/tokens.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NFA 8192
+#define MAX_DFA 4096
+#define MAX_RULES 128
+#define MAX_CLASSES 64
+#define NAME_SIZE 64
+
+typedef struct {
+  unsigned char bits[32];
+} ByteSet;
+
+typedef struct {
+  int out1;    // Epsilon moves, -1 for none
+  int out2;
+  int next;    // Move on a byte in set, -1 for none
+  ByteSet set;
+  int accept;  // Rule index + 1, 0 if not accepting
+} NfaState;
+
+/* Part of an NFA under construction; end has no moves yet */
+typedef struct {
+  int start;
+  int end;
+} Fragment;
+
+typedef struct {
+  char action[NAME_SIZE];
+  int keyword; // KeywordId for keyword rules, else KEYWORD_NONE
+} Rule;
+
+typedef struct {
+  char name[NAME_SIZE];
+  ByteSet set;
+} NamedClass;
+
+static NfaState nfa[MAX_NFA];
+static int nfa_count;
+static Rule rules[MAX_RULES];
+static int rule_count;
+static NamedClass classes[MAX_CLASSES];
+static int class_count;
+
+static const char *spec_path;
+static int spec_line;
+static const char *cursor; // Pattern being parsed
+
+static const char *const keyword_ids[] = {
+    "NONE",
+#define KEYWORD(id, text) #id,
+#include "../include/keywords.def"
+#undef KEYWORD
+};
+
+static const char *const keyword_texts[] = {
+    "",
+#define KEYWORD(id, text) text,
+#include "../include/keywords.def"
+#undef KEYWORD
+};
+
+static void fail(const char *message) {
+  fprintf(stderr, "%s:%d: %s\n", spec_path, spec_line, message);
+  exit(1);
+}
+
+static void set_add(ByteSet *set, int byte) {
+  set->bits[byte >> 3] |= (unsigned char)(1 << (byte & 7));
+}
+
+static int set_has(const ByteSet *set, int byte) {
+  return (set->bits[byte >> 3] >> (byte & 7)) & 1;
+}
+
+static int new_state(void) {
+  NfaState *state;
+
+  if (nfa_count == MAX_NFA) {
+    fail("too many NFA states");
+  }
+  state = &nfa[nfa_count];
+  memset(state, 0, sizeof(*state));
+  state->out1 = -1;
+  state->out2 = -1;
+  state->next = -1;
+  return nfa_count++;
+}
+
+static Fragment fragment_set(const ByteSet *set) {
+  Fragment fragment = {new_state(), new_state()};
+
+  nfa[fragment.start].set = *set;
+  nfa[fragment.start].next = fragment.end;
+  return fragment;
+}
+
+static Fragment fragment_byte(int byte) {
+  ByteSet set;
+
+  memset(&set, 0, sizeof(set));
+  set_add(&set, byte);
+  return fragment_set(&set);
+}
+
+static Fragment fragment_empty(void) {
+  int state = new_state();
+  Fragment fragment = {state, state};
+
+  return fragment;
+}
+
+static Fragment fragment_concat(Fragment a, Fragment b) {
+  Fragment fragment = {a.start, b.end};
+
+  nfa[a.end].out1 = b.start;
+  return fragment;
+}
+
+static Fragment fragment_alternate(Fragment a, Fragment b) {
+  Fragment fragment = {new_state(), new_state()};
+
+  nfa[fragment.start].out1 = a.start;
+  nfa[fragment.start].out2 = b.start;
+  nfa[a.end].out1 = fragment.end;
+  nfa[b.end].out1 = fragment.end;
+  return fragment;
+}
+
+/* a*, a+ or a? */
+static Fragment fragment_repeat(Fragment a, char op) {
+  Fragment fragment = {new_state(), new_state()};
+
+  nfa[fragment.start].out1 = a.start;
+  if (op != '+') {
+    nfa[fragment.start].out2 = fragment.end;
+  }
+  nfa[a.end].out1 = fragment.end;
+  if (op != '?') {
+    nfa[a.end].out2 = a.start;
+  }
+  return fragment;
+}
+
+static const NamedClass *find_class(const char *name, size_t length) {
+  int i;
+
+  for (i = 0; i < class_count; i++) {
+    if (strlen(classes[i].name) == length && strncmp(classes[i].name, name, length) == 0) {
+      return &classes[i];
+    }
+  }
+  fail("unknown class");
+  return NULL;
+}
+
+/* The byte an escape after a backslash stands for */
+static int parse_escape(void) {
+  char c = *cursor++;
+
+  switch (c) {
+  case 'n':
+    return '\n';
+  case 'r':
+    return '\r';
+  case 't':
+    return '\t';
+  case '0':
+    return '\0';
+  case 'x': {
+    int value = 0;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+      char h = *cursor++;
+
+      value = value * 16 + (h >= '0' && h <= '9' ? h - '0' : h >= 'a' && h <= 'f' ? h - 'a' + 10
+                                                 : h >= 'A' && h <= 'F' ? h - 'A' + 10 : (fail("bad \\x escape"), 0));
+    }
+    return value;
+  }
+  case '\0':
+    fail("pattern ends with a backslash");
+    return 0;
+  default:
+    return (unsigned char)c;
+  }
+}
+
+/* A {name} reference, cursor just past the '{' */
+static const NamedClass *parse_reference(void) {
+  const char *end = strchr(cursor, '}');
+  const NamedClass *named;
+
+  if (end == NULL) {
+    fail("missing }");
+  }
+  named = find_class(cursor, end - cursor);
+  cursor = end + 1;
+  return named;
+}
+
+/* A [...] class, cursor just past the '[' */
+static void parse_class(ByteSet *set) {
+  int negate = 0;
+  int i;
+
+  memset(set, 0, sizeof(*set));
+  if (*cursor == '^') {
+    negate = 1;
+    cursor++;
+  }
+  while (*cursor != ']') {
+    int low;
+    int high;
+
+    if (*cursor == '\0') {
+      fail("missing ]");
+    }
+    if (*cursor == '{') {
+      const NamedClass *named;
+
+      cursor++;
+      named = parse_reference();
+      for (i = 0; i < 32; i++) {
+        set->bits[i] |= named->set.bits[i];
+      }
+      continue;
+    }
+    low = *cursor == '\\' ? (cursor++, parse_escape()) : (unsigned char)*cursor++;
+    high = low;
+    if (cursor[0] == '-' && cursor[1] != ']' && cursor[1] != '\0') {
+      cursor++;
+      high = *cursor == '\\' ? (cursor++, parse_escape()) : (unsigned char)*cursor++;
+      if (high < low) {
+        fail("backwards range");
+      }
+    }
+    for (i = low; i <= high; i++) {
+      set_add(set, i);
+    }
+  }
+  cursor++;
+  if (negate) {
+    for (i = 0; i < 32; i++) {
+      set->bits[i] = (unsigned char)~set->bits[i];
+    }
+  }
+}
+
+static Fragment parse_alternation(void);
+
+static Fragment parse_atom(void) {
+  ByteSet set;
+  char c = *cursor++;
+
+  switch (c) {
+  case '(': {
+    Fragment inner = parse_alternation();
+
+    if (*cursor++ != ')') {
+      fail("missing )");
+    }
+    return inner;
+  }
+  case '[':
+    parse_class(&set);
+    return fragment_set(&set);
+  case '{':
+    return fragment_set(&parse_reference()->set);
+  case '.':
+    memset(&set, 0xff, sizeof(set));
+    return fragment_set(&set);
+  case '\\':
+    return fragment_byte(parse_escape());
+  default:
+    return fragment_byte((unsigned char)c);
+  }
+}
+
+static Fragment parse_repeats(void) {
+  Fragment fragment = parse_atom();
+
+  while (*cursor == '*' || *cursor == '+' || *cursor == '?') {
+    fragment = fragment_repeat(fragment, *cursor++);
+  }
+  return fragment;
+}
+
+static Fragment parse_sequence(void) {
+  Fragment fragment = fragment_empty();
+
+  while (*cursor != '\0' && *cursor != '|' && *cursor != ')') {
+    if (*cursor == '*' || *cursor == '+' || *cursor == '?') {
+      fail("repeat with nothing before it");
+    }
+    fragment = fragment_concat(fragment, parse_repeats());
+  }
+  return fragment;
+}
+
+static Fragment parse_alternation(void) {
+  Fragment fragment = parse_sequence();
+
+  while (*cursor == '|') {
+    cursor++;
+    fragment = fragment_alternate(fragment, parse_sequence());
+  }
+  return fragment;
+}
+
+static int add_rule(const char *action, int keyword, Fragment fragment) {
+  if (rule_count == MAX_RULES) {
+    fail("too many rules");
+  }
+  snprintf(rules[rule_count].action, NAME_SIZE, "%s", action);
+  rules[rule_count].keyword = keyword;
+  nfa[fragment.end].accept = rule_count + 1;
+  return fragment.start;
+}
+
+/* Split a spec line into its name and the pattern after it */
+static char *split_line(char *line, char **pattern) {
+  char *end = line + strlen(line);
+  char *name;
+
+  while (end > line && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) {
+    *--end = '\0';
+  }
+  while (*line == ' ' || *line == '\t') {
+    line++;
+  }
+  if (*line == '\0' || *line == '#') {
+    return NULL;
+  }
+  name = line;
+  while (*line != '\0' && *line != ' ' && *line != '\t') {
+    line++;
+  }
+  if (*line != '\0') {
+    *line++ = '\0';
+  }
+  while (*line == ' ' || *line == '\t') {
+    line++;
+  }
+  *pattern = line;
+  return name;
+}
+
+/* Parse the spec into an NFA, returning its start state */
+static int read_spec(FILE *file) {
+  char line[1024];
+  int start = new_state();
+  int last = start; // Rule starts hang off a chain of epsilon states
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char *pattern;
+    char *name;
+
+    spec_line++;
+    name = split_line(line, &pattern);
+    if (name == NULL) {
+      continue;
+    }
+    if (*pattern == '\0') {
+      fail("rule without a pattern");
+    }
+
+    // name = [class]
+    if (pattern[0] == '=') {
+      pattern++;
+      while (*pattern == ' ' || *pattern == '\t') {
+        pattern++;
+      }
+      if (*pattern != '[' || class_count == MAX_CLASSES) {
+        fail("a class definition needs a [...] class");
+      }
+      snprintf(classes[class_count].name, NAME_SIZE, "%s", name);
+      cursor = pattern + 1;
+      parse_class(&classes[class_count].set);
+      if (*cursor != '\0') {
+        fail("junk after class");
+      }
+      class_count++;
+      continue;
+    }
+
+    // ACTION @keywords: one rule per line of keywords.def
+    if (strcmp(pattern, "@keywords") == 0) {
+      int keyword;
+
+      for (keyword = 1; keyword < KEYWORD_COUNT; keyword++) {
+        Fragment fragment = fragment_empty();
+        char action[NAME_SIZE];
+        const char *text;
+
+        for (text = keyword_texts[keyword]; *text != '\0'; text++) {
+          fragment = fragment_concat(fragment, fragment_byte((unsigned char)*text));
+        }
+        snprintf(action, sizeof(action), "%s_%s", name, keyword_ids[keyword]);
+        nfa[last].out1 = add_rule(action, keyword, fragment);
+        rule_count++;
+        nfa[last].out2 = new_state();
+        last = nfa[last].out2;
+      }
+      continue;
+    }
+
+    cursor = pattern;
+    {
+      Fragment fragment = parse_alternation();
+
+      if (*cursor != '\0') {
+        fail("unbalanced )");
+      }
+      nfa[last].out1 = add_rule(name, KEYWORD_NONE, fragment);
+      rule_count++;
+      nfa[last].out2 = new_state();
+      last = nfa[last].out2;
+    }
+  }
+  return start;
+}
+
+/* Sets of NFA states, as bitmaps */
+static int set_words;
+
+typedef struct {
+  unsigned long long *states;
+  int accept; // Rule index + 1 of the earliest accepting rule, 0 for none
+} DfaState;
+
+static DfaState dfa[MAX_DFA];
+static int dfa_count;
+static int byte_class[256];
+static int class_total;
+static int class_byte[256]; // A byte of each class
+static int *transitions;    // [dfa_count][class_total]
+
+static void closure(unsigned long long *set) {
+  int stack[MAX_NFA];
+  int depth = 0;
+  int i;
+
+  for (i = 0; i < nfa_count; i++) {
+    if (set[i / 64] >> (i % 64) & 1) {
+      stack[depth++] = i;
+    }
+  }
+  while (depth > 0) {
+    int state = stack[--depth];
+    int outs[2] = {nfa[state].out1, nfa[state].out2};
+    int k;
+
+    for (k = 0; k < 2; k++) {
+      int to = outs[k];
+
+      if (to >= 0 && !(set[to / 64] >> (to % 64) & 1)) {
+        set[to / 64] |= 1ull << (to % 64);
+        stack[depth++] = to;
+      }
+    }
+  }
+}
+
+/* Index of the DFA state for set, adding it if it's new */
+static int find_dfa(unsigned long long *set) {
+  int i;
+
+  for (i = 0; i < dfa_count; i++) {
+    if (memcmp(dfa[i].states, set, set_words * sizeof(unsigned long long)) == 0) {
+      return i;
+    }
+  }
+  if (dfa_count == MAX_DFA) {
+    fail("too many DFA states");
+  }
+  dfa[dfa_count].states = malloc(set_words * sizeof(unsigned long long));
+  memcpy(dfa[dfa_count].states, set, set_words * sizeof(unsigned long long));
+  dfa[dfa_count].accept = 0;
+  for (i = 0; i < nfa_count; i++) {
+    if ((set[i / 64] >> (i % 64) & 1) && nfa[i].accept &&
+        (dfa[dfa_count].accept == 0 || nfa[i].accept < dfa[dfa_count].accept)) {
+      dfa[dfa_count].accept = nfa[i].accept;
+    }
+  }
+  return dfa_count++;
+}
+
+/* Group bytes that every NFA move treats the same way */
+static void find_byte_classes(void) {
+  int byte;
+
+  class_total = 0;
+  for (byte = 0; byte < 256; byte++) {
+    int c;
+
+    byte_class[byte] = -1;
+    for (c = 0; c < class_total && byte_class[byte] < 0; c++) {
+      int other = class_byte[c];
+      int i;
+
+      for (i = 0; i < nfa_count; i++) {
+        if (nfa[i].next >= 0 && set_has(&nfa[i].set, byte) != set_has(&nfa[i].set, other)) {
+          break;
+        }
+      }
+      if (i == nfa_count) {
+        byte_class[byte] = c;
+      }
+    }
+    if (byte_class[byte] < 0) {
+      class_byte[class_total] = byte;
+      byte_class[byte] = class_total++;
+    }
+  }
+}
+
+static void build_dfa(int start) {
+  unsigned long long *set = calloc(set_words, sizeof(unsigned long long));
+  int state;
+
+  // state 0 is the dead state, the empty set
+  find_dfa(set);
+  set[start / 64] |= 1ull << (start % 64);
+  closure(set);
+  find_dfa(set);
+
+  transitions = malloc(sizeof(int) * MAX_DFA * class_total);
+  for (state = 0; state < dfa_count; state++) {
+    int c;
+
+    for (c = 0; c < class_total; c++) {
+      int byte = class_byte[c];
+      int i;
+
+      memset(set, 0, set_words * sizeof(unsigned long long));
+      for (i = 0; i < nfa_count; i++) {
+        if ((dfa[state].states[i / 64] >> (i % 64) & 1) && nfa[i].next >= 0 && set_has(&nfa[i].set, byte)) {
+          set[nfa[i].next / 64] |= 1ull << (nfa[i].next % 64);
+        }
+      }
+      closure(set);
+      transitions[state * class_total + c] = find_dfa(set);
+    }
+  }
+  free(set);
+}
+
+/* Action names in order of first appearance, the enum the lexer sees */
+static int action_of_rule[MAX_RULES];
+static const char *action_names[MAX_RULES];
+static int action_keyword[MAX_RULES];
+static int action_count;
+
+static void number_actions(void) {
+  int r;
+
+  for (r = 0; r < rule_count; r++) {
+    int a;
+
+    for (a = 0; a < action_count && strcmp(action_names[a], rules[r].action) != 0; a++) {
+    }
+    if (a == action_count) {
+      action_names[action_count] = rules[r].action;
+      action_keyword[action_count] = rules[r].keyword;
+      action_count++;
+    }
+    action_of_rule[r] = a + 1; // 0 is DFA_NONE
+  }
+}
+
+/* The tables as a C header
+ * dfa_next holds a row of DFA_ROW entries per state: the state's action,
+ * then the next state for each class of byte. States are numbered by where
+ * their row starts and dfa_class gives a byte's column, so a step is
+ * dfa_next[state + dfa_class[byte]], with no multiply in the way.
+ */
+static void write_tables(FILE *out) {
+  int row = class_total + 1;
+  const char *cell = dfa_count * row <= 65536 ? "unsigned short" : "unsigned int";
+  int i;
+  int c;
+
+  fprintf(out, "/* dfa_tables.h\n * Generated by dfagen from tokens.spec; edit the spec, not this file.\n */\n");
+  fprintf(out, "#ifndef DFA_TABLES_H\n#define DFA_TABLES_H\n\n");
+  fprintf(out, "#define DFA_STATE_COUNT %d\n#define DFA_CLASS_COUNT %d\n", dfa_count, class_total);
+  fprintf(out, "#define DFA_ROW (DFA_CLASS_COUNT + 1)\n\n");
+  fprintf(out, "/* States, by the offset of their row in dfa_next */\n");
+  fprintf(out, "#define DFA_DEAD 0\n#define DFA_START DFA_ROW\n\n");
+
+  fprintf(out, "/* What an accepting state matched */\nenum {\n  DFA_NONE,\n");
+  for (i = 0; i < action_count; i++) {
+    fprintf(out, "  DFA_%s,\n", action_names[i]);
+  }
+  fprintf(out, "  DFA_ACTION_COUNT\n};\n\n");
+
+  fprintf(out, "/* Column of each byte's class in a row of dfa_next */\nstatic const unsigned char dfa_class[256] = {");
+  for (i = 0; i < 256; i++) {
+    fprintf(out, "%s%d,", i % 16 ? " " : "\n    ", byte_class[i] + 1);
+  }
+  fprintf(out, "\n};\n\n");
+
+  fprintf(out, "/* Each state's action (DFA_NONE if it doesn't accept), then its next\n");
+  fprintf(out, " * state on each class\n */\n");
+  fprintf(out, "static const %s dfa_next[DFA_STATE_COUNT * DFA_ROW] = {\n", cell);
+  for (i = 0; i < dfa_count; i++) {
+    fprintf(out, "    %d,", dfa[i].accept ? action_of_rule[dfa[i].accept - 1] : 0);
+    for (c = 0; c < class_total; c++) {
+      fprintf(out, " %d,", transitions[i * class_total + c] * row);
+    }
+    fprintf(out, "\n");
+  }
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "/* KeywordId of each action, KEYWORD_NONE for the rest */\n");
+  fprintf(out, "static const unsigned char dfa_keyword[DFA_ACTION_COUNT] = {\n    0,");
+  for (i = 0; i < action_count; i++) {
+    fprintf(out, " %d,", action_keyword[i]);
+  }
+  fprintf(out, "\n};\n\n#endif /* DFA_TABLES_H */\n");
+}
+
+int main(int argc, char **argv) {
+  FILE *file;
+  int start;
+
+  if (argc != 3) {
+    fprintf(stderr, "usage: dfagen tokens.spec dfa_tables.h\n");
+    return 1;
+  }
+  spec_path = argv[1];
+  file = fopen(spec_path, "r");
+  if (file == NULL) {
+    perror(spec_path);
+    return 1;
+  }
+  start = read_spec(file);
+  fclose(file);
+  if (rule_count == 0) {
+    fail("no rules");
+  }
+
+  set_words = (nfa_count + 63) / 64;
+  number_actions();
+  find_byte_classes();
+  build_dfa(start);
+  if (action_count + 1 > 255) {
+    fail("too many actions");
+  }
+
+  file = fopen(argv[2], "w");
+  if (file == NULL) {
+    perror(argv[2]);
+    return 1;
+  }
+  write_tables(file);
+  return fclose(file) == 0 ? 0 : 1;
+}